@@ -0,0 +1,195 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#ifndef YALDB_ARENA_H_
+#define YALDB_ARENA_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "yaldb/thread_annotation.h"
+
+namespace yaldb {
+
+// Bump allocator handing out memory carved from large blocks. Memory is
+// never returned piecemeal: all blocks are released together when the arena
+// is destroyed. Callers own the lifetime of the objects they construct in
+// the returned memory. Allocation is not thread-safe, but MemoryUsage may be
+// read concurrently with it.
+template<typename Alloc = std::allocator<char>>
+class Arena {
+ public:
+  using allocator_type = Alloc;
+
+  explicit Arena(const Alloc &alloc = Alloc()) :
+      alloc_(alloc), alloc_ptr_(nullptr), alloc_bytes_remaining_(0),
+      memory_usage_(0) {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+
+  const Alloc &get_allocator() const { return alloc_; }
+  char *Allocate(size_t bytes);
+  char *AllocateAligned(size_t bytes,
+                        size_t align = alignof(std::max_align_t));
+  // bytes reserved from the underlying allocator, including block slack
+  size_t MemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  using AllocTraits = std::allocator_traits<Alloc>;
+  static constexpr size_t kBlockSize = 4096;
+
+  char *AllocateFallback(size_t bytes, size_t align);
+  char *AllocateNewBlock(size_t block_bytes);
+
+  Alloc alloc_;
+  char *alloc_ptr_;
+  size_t alloc_bytes_remaining_;
+  std::vector<std::pair<char *, size_t>> blocks_;
+  std::atomic<size_t> memory_usage_;
+};
+
+template<typename Alloc>
+Arena<Alloc>::~Arena() {
+  for (auto &[block, bytes] : blocks_) {
+    AllocTraits::deallocate(alloc_, block, bytes);
+  }
+}
+template<typename Alloc>
+char *Arena<Alloc>::Allocate(size_t bytes) {
+  assert(bytes > 0);
+  if (bytes <= alloc_bytes_remaining_) {
+    char *result = alloc_ptr_;
+    alloc_ptr_ += bytes;
+    alloc_bytes_remaining_ -= bytes;
+    return result;
+  }
+  return AllocateFallback(bytes, 1);
+}
+template<typename Alloc>
+char *Arena<Alloc>::AllocateAligned(size_t bytes, size_t align) {
+  assert(bytes > 0);
+  assert((align & (align - 1)) == 0);
+  const size_t mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
+  const size_t slop = mod == 0 ? 0 : align - mod;
+  const size_t needed = bytes + slop;
+  if (needed <= alloc_bytes_remaining_) {
+    char *result = alloc_ptr_ + slop;
+    alloc_ptr_ += needed;
+    alloc_bytes_remaining_ -= needed;
+    return result;
+  }
+  return AllocateFallback(bytes, align);
+}
+template<typename Alloc>
+char *Arena<Alloc>::AllocateFallback(size_t bytes, size_t align) {
+  if (bytes > kBlockSize / 4) {
+    // large objects get a block of their own so that the remaining bytes of
+    // the current block are not wasted
+    char *block = AllocateNewBlock(bytes + align - 1);
+    const size_t mod = reinterpret_cast<uintptr_t>(block) & (align - 1);
+    return mod == 0 ? block : block + align - mod;
+  }
+  alloc_ptr_ = AllocateNewBlock(kBlockSize);
+  alloc_bytes_remaining_ = kBlockSize;
+  char *result = AllocateAligned(bytes, align);
+  assert(result != nullptr);
+  return result;
+}
+template<typename Alloc>
+char *Arena<Alloc>::AllocateNewBlock(size_t block_bytes) {
+  char *block = AllocTraits::allocate(alloc_, block_bytes);
+  blocks_.emplace_back(block, block_bytes);
+  memory_usage_.fetch_add(block_bytes + sizeof(std::pair<char *, size_t>),
+                          std::memory_order_relaxed);
+  return block;
+}
+
+// Arena that can additionally be shared by several allocating threads.
+// AllocateAlignedConcurrently bumps from a small chunk owned by one of a few
+// per-thread shards, so concurrent callers rarely meet on the same lock;
+// only refilling a chunk takes the lock of the backing arena.
+// AllocateAligned is the unsynchronized fast path for phases with a single
+// allocating thread and must not overlap with concurrent allocation.
+template<typename Alloc = std::allocator<char>>
+class ConcurrentArena {
+ public:
+  using allocator_type = Alloc;
+
+  explicit ConcurrentArena(const Alloc &alloc = Alloc()) : arena_(alloc) {}
+  ConcurrentArena(const ConcurrentArena &) = delete;
+  ConcurrentArena &operator=(const ConcurrentArena &) = delete;
+
+  char *AllocateAligned(size_t bytes,
+                        size_t align = alignof(std::max_align_t)) {
+    return arena_.AllocateAligned(bytes, align);
+  }
+  char *AllocateAlignedConcurrently(size_t bytes,
+                                    size_t align = alignof(std::max_align_t));
+  size_t MemoryUsage() const { return arena_.MemoryUsage(); }
+  const Alloc &get_allocator() const { return arena_.get_allocator(); }
+
+ private:
+  static constexpr size_t kNumShards = 8;
+  static constexpr size_t kShardChunkSize = 1024;
+
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    char *alloc_ptr GUARDED_BY(mutex) = nullptr;
+    size_t alloc_bytes_remaining GUARDED_BY(mutex) = 0;
+  };
+
+  static size_t ShardIndex();
+
+  std::mutex mutex_;
+  Arena<Alloc> arena_;
+  Shard shards_[kNumShards];
+};
+
+template<typename Alloc>
+char *ConcurrentArena<Alloc>::AllocateAlignedConcurrently(
+    size_t bytes, size_t align) {
+  assert((align & (align - 1)) == 0);
+  if (bytes > kShardChunkSize / 4) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return arena_.AllocateAligned(bytes, align);
+  }
+  Shard &shard = shards_[ShardIndex()];
+  std::lock_guard<std::mutex> shard_guard(shard.mutex);
+  size_t mod = reinterpret_cast<uintptr_t>(shard.alloc_ptr) & (align - 1);
+  size_t slop = mod == 0 ? 0 : align - mod;
+  if (bytes + slop > shard.alloc_bytes_remaining) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      shard.alloc_ptr = arena_.AllocateAligned(kShardChunkSize);
+    }
+    shard.alloc_bytes_remaining = kShardChunkSize;
+    mod = reinterpret_cast<uintptr_t>(shard.alloc_ptr) & (align - 1);
+    slop = mod == 0 ? 0 : align - mod;
+    assert(bytes + slop <= shard.alloc_bytes_remaining);
+  }
+  char *result = shard.alloc_ptr + slop;
+  shard.alloc_ptr += bytes + slop;
+  shard.alloc_bytes_remaining -= bytes + slop;
+  return result;
+}
+template<typename Alloc>
+size_t ConcurrentArena<Alloc>::ShardIndex() {
+  static std::atomic<size_t> next_index(0);
+  thread_local size_t index =
+      next_index.fetch_add(1, std::memory_order_relaxed) % kNumShards;
+  return index;
+}
+
+}  // namespace yaldb
+
+#endif  // YALDB_ARENA_H_
@@ -6,16 +6,29 @@
 
 #include <cassert>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
 #include <functional>
+#include <future>  // NOLINT
 #include <list>
 #include <memory>
 #include <mutex>  // NOLINT
+#include <shared_mutex>  // NOLINT
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "yaldb/cache_policy.h"
+#include "yaldb/hash.h"
+#include "yaldb/shard.h"
 #include "yaldb/thread_annotation.h"
+#include "yaldb/timing_wheel.h"
 
 namespace yaldb {
 
@@ -23,175 +36,1122 @@ template<typename T>
 class Cache;
 
 template<typename T>
-std::unique_ptr<Cache<T>> NewLRUCache(size_t capacity);
+std::unique_ptr<Cache<T>> NewLRUCache(
+    size_t capacity, int num_shard_bits = -1);
+template<typename T>
+std::unique_ptr<Cache<T>> NewLRUCache(
+    size_t capacity, std::function<void(std::pair<std::string, T> *)> deleter,
+    int num_shard_bits = -1);
+
+// the time entries expire by, steady_clock::now unless a test injects a
+// fake one
+using CacheClock = std::function<std::chrono::steady_clock::time_point()>;
 
+// Capacity is measured in the charges given to Put, in whatever unit the
+// caller picks, such as bytes. Entries put without a charge weigh 1.
+// Entries put with a ttl expire that long after: no Get returns them past
+// it, and shards reclaim them as their clock goes by, without scanning.
+// Every operation takes an optional hash, which must be Hash(key). Callers
+// looking the same key up in several places compute it once, and the cache
+// uses it both to pick a shard and in the table of the shard.
 template<typename T>
 class Cache {
  public:
   using PairType = std::pair<std::string, T>;
   using PairPtr = std::shared_ptr<PairType>;
   using DeleterType = std::function<void(PairType *)>;
+  using Duration = std::chrono::steady_clock::duration;
+
+  // ttl of the entries which never expire
+  static constexpr Duration kNoExpiry = Duration::max();
 
   Cache() : deleter_(std::default_delete<PairType>()) {}
   explicit Cache(DeleterType deleter) :
       deleter_(deleter) {}
   virtual ~Cache() = default;
-  virtual void Put(const std::string &key, T value) = 0;
-  [[nodiscard]] virtual PairPtr Get(const std::string &key) = 0;
-  [[nodiscard]] virtual PairPtr Del(const std::string &key) = 0;
+  void Put(std::string_view key, T value) { Put(key, std::move(value), 1); }
+  void Put(std::string_view key, T value, size_t charge) {
+    Put(key, std::move(value), charge, kNoExpiry, Hash(key));
+  }
+  void Put(std::string_view key, T value, Duration ttl) {
+    Put(key, std::move(value), 1, ttl, Hash(key));
+  }
+  void Put(std::string_view key, T value, size_t charge, Duration ttl) {
+    Put(key, std::move(value), charge, ttl, Hash(key));
+  }
+  void Put(std::string_view key, T value, size_t charge, uint64_t hash) {
+    Put(key, std::move(value), charge, kNoExpiry, hash);
+  }
+  virtual void Put(std::string_view key, T value, size_t charge,
+                   Duration ttl, uint64_t hash) = 0;
+  [[nodiscard]] PairPtr Get(std::string_view key) {
+    return Get(key, Hash(key));
+  }
+  [[nodiscard]] virtual PairPtr Get(std::string_view key, uint64_t hash) = 0;
+  // like Put, returning a handle on the new entry
+  [[nodiscard]] PairPtr Insert(std::string_view key, T value,
+                               size_t charge = 1, Duration ttl = kNoExpiry) {
+    return Insert(key, std::move(value), charge, ttl, Hash(key));
+  }
+  [[nodiscard]] PairPtr Insert(std::string_view key, T value, size_t charge,
+                               uint64_t hash) {
+    return Insert(key, std::move(value), charge, kNoExpiry, hash);
+  }
+  [[nodiscard]] virtual PairPtr Insert(std::string_view key, T value,
+                                       size_t charge, Duration ttl,
+                                       uint64_t hash) = 0;
+  // the value of key, inserting the one loader returns on a miss.
+  // Concurrent misses of a key run loader once, the other callers wait for
+  // it and share its value, or the exception it throws. loader must not
+  // load key itself.
+  [[nodiscard]] PairPtr GetOrLoad(std::string_view key,
+                                  const std::function<T()> &loader,
+                                  size_t charge = 1,
+                                  Duration ttl = kNoExpiry) {
+    return GetOrLoad(key, loader, charge, ttl, Hash(key));
+  }
+  [[nodiscard]] PairPtr GetOrLoad(std::string_view key,
+                                  const std::function<T()> &loader,
+                                  size_t charge, uint64_t hash) {
+    return GetOrLoad(key, loader, charge, kNoExpiry, hash);
+  }
+  [[nodiscard]] virtual PairPtr GetOrLoad(
+      std::string_view key, const std::function<T()> &loader, size_t charge,
+      Duration ttl, uint64_t hash);
+  [[nodiscard]] PairPtr Del(std::string_view key) {
+    return Del(key, Hash(key));
+  }
+  [[nodiscard]] virtual PairPtr Del(std::string_view key, uint64_t hash) = 0;
+  // values of keys by index, nullptr for the ones missed. Caches override
+  // it to take every lock once for the batch
+  [[nodiscard]] virtual std::vector<PairPtr> MultiGet(
+      std::span<const std::string_view> keys);
+  // puts every pair, pairs[i] with a charge of charges[i], or of 1 if
+  // charges is empty, and all of them with ttl
+  void MultiPut(std::span<const std::pair<std::string_view, T>> pairs) {
+    MultiPut(pairs, {}, kNoExpiry);
+  }
+  void MultiPut(std::span<const std::pair<std::string_view, T>> pairs,
+                std::span<const size_t> charges) {
+    MultiPut(pairs, charges, kNoExpiry);
+  }
+  virtual void MultiPut(std::span<const std::pair<std::string_view, T>> pairs,
+                        std::span<const size_t> charges, Duration ttl);
+  // sum of the charges of the cached entries
+  [[nodiscard]] virtual size_t TotalCharge() = 0;
+  // charge of every shard, by index, a single one if not sharded
+  [[nodiscard]] virtual std::vector<size_t> ShardCharges() {
+    return {TotalCharge()};
+  }
+  // the largest charge of a shard over the mean, 1 when perfectly even
+  [[nodiscard]] double Skew();
  protected:
   DeleterType deleter_;
+
+ private:
+  std::mutex loads_mutex_;
+  // the loads running, by key
+  std::unordered_map<std::string, std::shared_future<PairPtr>> loads_
+      GUARDED_BY(loads_mutex_);
 };
+template<typename T>
+typename Cache<T>::PairPtr Cache<T>::GetOrLoad(
+    std::string_view key, const std::function<T()> &loader, size_t charge,
+    Duration ttl, uint64_t hash) {
+  if (PairPtr value = Get(key, hash); value != nullptr) return value;
+  std::unique_lock<std::mutex> lock(loads_mutex_);
+  std::string name(key);
+  if (auto found = loads_.find(name); found != loads_.end()) {
+    std::shared_future<PairPtr> load = found->second;
+    lock.unlock();
+    return load.get();
+  }
+  // a load may have finished since the miss
+  if (PairPtr value = Get(key, hash); value != nullptr) return value;
+  std::promise<PairPtr> promise;
+  loads_.emplace(name, promise.get_future().share());
+  lock.unlock();
+  PairPtr value;
+  try {
+    value = Insert(key, loader(), charge, ttl, hash);
+  } catch (...) {
+    lock.lock();
+    loads_.erase(name);
+    lock.unlock();
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+  // the value is cached already, so later misses of key find it
+  lock.lock();
+  loads_.erase(name);
+  lock.unlock();
+  promise.set_value(value);
+  return value;
+}
+template<typename T>
+double Cache<T>::Skew() {
+  const std::vector<size_t> charges = ShardCharges();
+  size_t total = 0, max = 0;
+  for (size_t charge : charges) {
+    total += charge;
+    max = std::max(max, charge);
+  }
+  if (total == 0) return 1;
+  return static_cast<double>(max) * charges.size() / total;
+}
+template<typename T>
+std::vector<typename Cache<T>::PairPtr> Cache<T>::MultiGet(
+    std::span<const std::string_view> keys) {
+  std::vector<PairPtr> values;
+  values.reserve(keys.size());
+  for (std::string_view key : keys) {
+    values.push_back(Get(key));
+  }
+  return values;
+}
+template<typename T>
+void Cache<T>::MultiPut(std::span<const std::pair<std::string_view, T>> pairs,
+                        std::span<const size_t> charges, Duration ttl) {
+  assert(charges.empty() || charges.size() == pairs.size());
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    Put(pairs[i].first, pairs[i].second, charges.empty() ? 1 : charges[i],
+        ttl);
+  }
+}
 
 namespace impl {
 
-template<typename T>
-class LRUCache : public Cache<T> {
+// key of the table of a shard: a view of the key owned by its entry, and
+// the hash of the key, so that the table never hashes a string
+struct HashedKey {
+  std::string_view key;
+  uint64_t hash;
+
+  bool operator==(const HashedKey &other) const {
+    return hash == other.hash && key == other.key;
+  }
+};
+struct HashedKeyHash {
+  size_t operator()(const HashedKey &key) const noexcept { return key.hash; }
+};
+
+// loads the bucket of key and prefetches its first node. The table of the
+// standard keeps its bucket array to itself, so the load of the bucket is
+// not prefetched but a plain one, which may miss: batches issue it for all
+// their keys before probing any, which only lets the misses of different
+// keys overlap
+template<typename Map>
+void WarmBucket(const Map &map, const HashedKey &key) {
+  const size_t bucket = map.bucket(key);
+  if (auto node = map.begin(bucket); node != map.end(bucket)) {
+    __builtin_prefetch(&*node);
+  }
+}
+
+// Expiration of the entries of a shard, which embed a TimerNode: a timing
+// wheel of millisecond ticks of clock, advanced by the shard under its
+// exclusive lock. An entry is reclaimed by the first advance past the tick
+// it expires in, and Expired tells the ones in between exactly.
+class Expiration {
+ public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+  using Duration = std::chrono::steady_clock::duration;
+
+  explicit Expiration(CacheClock clock) :
+      clock_(std::move(clock)), epoch_(clock_()), wheel_(0) {}
+
+  // whether an entry expiring at expiry has, never reading the clock for
+  // the entries which never expire
+  [[nodiscard]] bool Expired(TimePoint expiry) const {
+    return expiry != TimePoint::max() && expiry <= clock_();
+  }
+  // schedules node to expire ttl from now, returning when it expires
+  TimePoint Schedule(TimerNode *node, Duration ttl);
+  void Cancel(TimerNode *node) { wheel_.Cancel(node); }
+  // passes the nodes expired by now to expire, unscheduled. Only reads the
+  // clock while some entry is to expire
+  template<typename Expire>
+  void Advance(Expire expire) {
+    if (wheel_.empty()) return;
+    const TimePoint now = clock_();
+    if (now > epoch_) wheel_.Advance((now - epoch_) / kTick, expire);
+  }
+
+ private:
+  static constexpr Duration kTick = std::chrono::milliseconds(1);
+
+  CacheClock clock_;
+  // the time of tick 0
+  TimePoint epoch_;
+  TimingWheel wheel_;
+};
+inline Expiration::TimePoint Expiration::Schedule(
+    TimerNode *node, Duration ttl) {
+  if (ttl == Duration::max()) return TimePoint::max();
+  const TimePoint now = clock_();
+  if (ttl >= TimePoint::max() - now) return TimePoint::max();
+  const TimePoint expiry = now + ttl;
+  // the first tick not before expiry
+  uint64_t deadline = 0;
+  if (expiry > epoch_) {
+    const Duration since = expiry - epoch_;
+    deadline = since / kTick + (since % kTick != Duration::zero());
+  }
+  wheel_.Schedule(node, deadline);
+  return expiry;
+}
+
+// Allocates from the storage of an entry when it is free and large enough,
+// from the heap otherwise. Copies share the storage, so it outlives the
+// control blocks allocated in it.
+template<typename U>
+class HandleAllocator {
+ public:
+  using value_type = U;
+
+  explicit HandleAllocator(std::shared_ptr<HandleStorage> storage) :
+      storage_(std::move(storage)) {}
+  template<typename V>
+  HandleAllocator(const HandleAllocator<V> &other) :  // NOLINT
+      storage_(other.storage_) {}
+
+  [[nodiscard]] U *allocate(size_t n);
+  void deallocate(U *p, size_t n);
+
+  template<typename V>
+  bool operator==(const HandleAllocator<V> &other) const {
+    return storage_ == other.storage_;
+  }
+
+ private:
+  template<typename V>
+  friend class HandleAllocator;
+
+  std::shared_ptr<HandleStorage> storage_;
+};
+template<typename U>
+U *HandleAllocator<U>::allocate(size_t n) {
+  static_assert(sizeof(U) <= HandleStorage::kSize &&
+                alignof(U) <= alignof(std::max_align_t),
+                "the control block of a handle must fit HandleStorage");
+  if (n == 1 && !storage_->busy.exchange(true, std::memory_order_acquire)) {
+    return reinterpret_cast<U *>(storage_->buffer);
+  }
+  return std::allocator<U>().allocate(n);
+}
+template<typename U>
+void HandleAllocator<U>::deallocate(U *p, size_t n) {
+  if (reinterpret_cast<std::byte *>(p) == storage_->buffer) {
+    storage_->busy.store(false, std::memory_order_release);
+  } else {
+    std::allocator<U>().deallocate(p, n);
+  }
+}
+
+// Cache whose unpinned entries are ordered by Policy, see cache_policy.h.
+// Entries referenced by a handle returned from Get are pinned on in_use_
+// instead, so eviction never has to skip them. The last copy of a handle
+// going away gives its entry back to the policy, and evicts if pinning let
+// the cache grow past its capacity. Handles may outlive the cache, keeping
+// only their pairs alive. The control block of a handle goes to a storage
+// made on the first pin of its entry, so that later hits allocate nothing.
+template<typename T, typename Policy>
+class PolicyCache : public Cache<T> {
  public:
   using PairType = typename Cache<T>::PairType;
   using PairPtr = typename Cache<T>::PairPtr;
   using DeleterType = typename Cache<T>::DeleterType;
+  using Duration = typename Cache<T>::Duration;
+
+  PolicyCache() : PolicyCache(0) {}
+  explicit PolicyCache(size_t capacity) :
+      PolicyCache(capacity, std::default_delete<PairType>()) {}
+  // entries expire by clock
+  PolicyCache(size_t capacity, DeleterType deleter,
+              CacheClock clock = std::chrono::steady_clock::now) :
+      Cache<T>(deleter), capacity_(capacity),
+      owner_(std::make_shared<Owner>()), mutex_(owner_->mutex), usage_(),
+      policy_(capacity), expiration_(std::move(clock)) {
+    owner_->cache = this;
+  }
+  ~PolicyCache() override;
+  using Cache<T>::Put;
+  using Cache<T>::Get;
+  using Cache<T>::Del;
+  void Put(std::string_view key, T value, size_t charge, Duration ttl,
+           uint64_t hash) override;
+  PairPtr Get(std::string_view key, uint64_t hash) override;
+  using Cache<T>::Insert;
+  PairPtr Insert(std::string_view key, T value, size_t charge, Duration ttl,
+                 uint64_t hash) override;
+  PairPtr Del(std::string_view key, uint64_t hash) override;
+  std::vector<PairPtr> MultiGet(
+      std::span<const std::string_view> keys) override;
+  using Cache<T>::MultiPut;
+  void MultiPut(std::span<const std::pair<std::string_view, T>> pairs,
+                std::span<const size_t> charges, Duration ttl) override;
+  size_t TotalCharge() override;
+  void set_capacity(size_t capacity);
 
-  LRUCache() : Cache<T>(), capacity_() {}
-  explicit LRUCache(size_t capacity) : Cache<T>(), capacity_(capacity) {}
-//  explicit LRUCache(DeleterType deleter) : Cache<T>(deleter), capacity_() {}
-  LRUCache(size_t capacity, DeleterType deleter) :
-      Cache<T>(deleter), capacity_(capacity) {}
-  ~LRUCache() override = default;
-  void Put(const std::string &key, T value) override;
-  PairPtr Get(const std::string &key) override;
-  PairPtr Del(const std::string &key) override;
-  void set_capacity(size_t capacity) { capacity_ = capacity; }
+  // batches of ShardedCache, of the keys at indices, with their hashes.
+  // values are stored by index
+  void MultiGet(std::span<const std::string_view> keys,
+                std::span<const uint64_t> hashes,
+                std::span<const size_t> indices, std::span<PairPtr> values);
+  void MultiPut(std::span<const std::pair<std::string_view, T>> pairs,
+                std::span<const size_t> charges, Duration ttl,
+                std::span<const uint64_t> hashes,
+                std::span<const size_t> indices);
 
  private:
-  using ListType = std::list<std::shared_ptr<PairType>>;
-  using MapType = std::unordered_map<std::string, typename ListType::iterator>;
+  using Entry = CacheEntry<T>;
+  using ListType = std::list<Entry>;
+  using MapType = std::unordered_map<
+      HashedKey, typename ListType::iterator, HashedKeyHash>;
+  // what handles refer to, which lives as long as the last of them. Holds
+  // the mutex of the shard, on a line of its own
+  struct alignas(kCacheLineSize) Owner {
+    std::mutex mutex;
+    // nullptr once the cache is destroyed
+    PolicyCache *cache GUARDED_BY(mutex) = nullptr;
+  };
+  static_assert(alignof(Owner) == kCacheLineSize &&
+                sizeof(Owner) % kCacheLineSize == 0);
+
+  // returns a handle on the new entry if pin, or nullptr
+  PairPtr PutLocked(std::string_view key, T value, size_t charge,
+                    Duration ttl, uint64_t hash, bool pin)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  PairPtr GetLocked(std::string_view key, uint64_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // a handle on the entry found, pinning it
+  PairPtr Ref(typename MapType::iterator found)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // called when the last copy of a handle on pair goes away
+  void Release(const PairPtr &pair, uint64_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // drops the entry found from the cache
+  void Erase(typename MapType::iterator found)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // drops the entries picked by the policy while over capacity
+  void Evict() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // drops the entries expired
+  void Expire() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   size_t capacity_;
-  std::mutex mutex_;
-  // store the shared pointers to pair of key and value
-  ListType list_ GUARDED_BY(mutex_);
+  std::shared_ptr<Owner> owner_;
+  std::mutex &mutex_;
+  // charge of all the entries, pinned or not
+  size_t usage_ GUARDED_BY(mutex_);
+  Policy policy_ GUARDED_BY(mutex_);
+  // entries with handles, in no particular order
+  ListType in_use_ GUARDED_BY(mutex_);
   MapType map_ GUARDED_BY(mutex_);
+  Expiration expiration_ GUARDED_BY(mutex_);
 };
-template<typename T>
-void LRUCache<T>::Put(const std::string &key, T value) {
+template<typename T, typename Policy>
+PolicyCache<T, Policy>::~PolicyCache() {
+  // handles alive release nothing from now on
+  std::lock_guard<std::mutex> guard(mutex_);
+  owner_->cache = nullptr;
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::Put(std::string_view key, T value, size_t charge,
+                                 Duration ttl, uint64_t hash) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  PutLocked(key, std::move(value), charge, ttl, hash, false);
+}
+template<typename T, typename Policy>
+typename PolicyCache<T, Policy>::PairPtr
+PolicyCache<T, Policy>::Get(std::string_view key, uint64_t hash) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  Expire();
+  return GetLocked(key, hash);
+}
+template<typename T, typename Policy>
+typename PolicyCache<T, Policy>::PairPtr PolicyCache<T, Policy>::Insert(
+    std::string_view key, T value, size_t charge, Duration ttl,
+    uint64_t hash) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return PutLocked(key, std::move(value), charge, ttl, hash, true);
+}
+template<typename T, typename Policy>
+std::vector<typename PolicyCache<T, Policy>::PairPtr>
+PolicyCache<T, Policy>::MultiGet(std::span<const std::string_view> keys) {
+  std::vector<uint64_t> hashes;
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    hashes.push_back(Hash(keys[i]));
+    indices.push_back(i);
+  }
+  std::vector<PairPtr> values(keys.size());
+  MultiGet(keys, hashes, indices, values);
+  return values;
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::MultiPut(
+    std::span<const std::pair<std::string_view, T>> pairs,
+    std::span<const size_t> charges, Duration ttl) {
+  assert(charges.empty() || charges.size() == pairs.size());
+  std::vector<uint64_t> hashes;
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    hashes.push_back(Hash(pairs[i].first));
+    indices.push_back(i);
+  }
+  MultiPut(pairs, charges, ttl, hashes, indices);
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::MultiGet(
+    std::span<const std::string_view> keys, std::span<const uint64_t> hashes,
+    std::span<const size_t> indices, std::span<PairPtr> values) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  Expire();
+  for (size_t i : indices) {
+    WarmBucket(map_, {keys[i], hashes[i]});
+  }
+  for (size_t i : indices) {
+    values[i] = GetLocked(keys[i], hashes[i]);
+  }
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::MultiPut(
+    std::span<const std::pair<std::string_view, T>> pairs,
+    std::span<const size_t> charges, Duration ttl,
+    std::span<const uint64_t> hashes, std::span<const size_t> indices) {
   std::lock_guard<std::mutex> guard(mutex_);
-  if (auto found = map_.find(key); found != map_.end()) {
+  for (size_t i : indices) {
+    WarmBucket(map_, {pairs[i].first, hashes[i]});
+  }
+  for (size_t i : indices) {
+    PutLocked(pairs[i].first, pairs[i].second,
+              charges.empty() ? 1 : charges[i], ttl, hashes[i], false);
+  }
+}
+template<typename T, typename Policy>
+typename PolicyCache<T, Policy>::PairPtr PolicyCache<T, Policy>::PutLocked(
+    std::string_view key, T value, size_t charge, Duration ttl,
+    uint64_t hash, bool pin) {
+  Expire();
+  policy_.Record(hash);
+  if (auto found = map_.find({key, hash}); found != map_.end()) {
     // key->value pair inserted before
-    // erase the old record in the list
-    list_.erase(found->second);
+    // erase the old record, handles on it keep the pair alive
+    Erase(found);
   }
-  // push new record into the list
-//  list_.push_front(std::make_shared<PairType>(
-//      std::make_pair(key, std::move(value))));
+  // hand the new record over to the policy
   auto *pair = new PairType(key, std::move(value));
-  list_.push_front(PairPtr(pair, this->deleter_));
-  // update / insert
-  map_.insert_or_assign(key, list_.begin());
-
-  assert(list_.size() == map_.size());
-  if (list_.size() > capacity_) {
-    // remove oldest item in the cache
-//    auto back = std::prev(list_.end());
-    typename ListType::iterator back;
-    for (back = std::prev(list_.end());
-        back->use_count() != 1 && back != list_.begin(); --back) {}
-    if (back->use_count() != 1) return;
-    [[maybe_unused]] auto back_slot = map_.find((*back)->first);
-    assert(back_slot != map_.end() && back_slot->second == back);
-    map_.erase(back_slot);
-//    list_.pop_back();
-    list_.erase(back);
-  }
-}
-template<typename T>
-typename LRUCache<T>::PairPtr
-LRUCache<T>::Get(const std::string &key) {
-  std::lock_guard<std::mutex> guard(mutex_);
-  auto found = map_.find(key);
+  ListType fresh;
+  fresh.push_front(
+      Entry{{}, PairPtr(pair, this->deleter_), hash, charge, 0, {}, {}, 0, {}});
+  auto it = fresh.begin();
+  it->expiry = expiration_.Schedule(&*it, ttl);
+  policy_.Add(&fresh, it);
+  usage_ += charge;
+  // update / insert, keyed by the key of the new pair
+  auto [found, inserted] = map_.emplace(HashedKey{pair->first, hash}, it);
+  assert(inserted);
+  // pinned before evicting, so that the handle is on a cached entry
+  PairPtr handle = pin ? Ref(found) : nullptr;
+  Evict();
+  return handle;
+}
+template<typename T, typename Policy>
+typename PolicyCache<T, Policy>::PairPtr
+PolicyCache<T, Policy>::GetLocked(std::string_view key, uint64_t hash) {
+  policy_.Record(hash);
+  auto found = map_.find({key, hash});
   if (found == map_.end()) return nullptr;
-  std::shared_ptr<PairType> value = *(found->second);
-  list_.erase(found->second);
-  list_.push_front(value);
-  map_.insert_or_assign(key, list_.begin());
-  return list_.front();
+  // expired since the wheel last advanced, within a tick
+  if (expiration_.Expired(found->second->expiry)) {
+    Erase(found);
+    return nullptr;
+  }
+  return Ref(found);
 }
-template<typename T>
-typename LRUCache<T>::PairPtr
-LRUCache<T>::Del(const std::string &key) {
+template<typename T, typename Policy>
+typename PolicyCache<T, Policy>::PairPtr
+PolicyCache<T, Policy>::Ref(typename MapType::iterator found) {
+  Entry &entry = *found->second;
+  if (PairPtr handle = entry.handle.lock(); handle != nullptr) {
+    return handle;
+  }
+  // the control block of the handle dead frees the storage once unobserved
+  entry.handle.reset();
+  if (entry.storage == nullptr) {
+    entry.storage = std::make_shared<HandleStorage>();
+  }
+  if (entry.refs++ == 0) {
+    policy_.Pin(found->second, &in_use_);
+  }
+  // the handle owns a reference to the pair, which may outlive the entry.
+  // Handles alive share its control block
+  PairPtr handle(
+      entry.pair.get(),
+      [owner = owner_, pair = entry.pair, hash = entry.hash](PairType *) {
+        std::lock_guard<std::mutex> guard(owner->mutex);
+        if (owner->cache != nullptr) owner->cache->Release(pair, hash);
+      },
+      HandleAllocator<PairType>(entry.storage));
+  entry.handle = handle;
+  return handle;
+}
+template<typename T, typename Policy>
+typename PolicyCache<T, Policy>::PairPtr
+PolicyCache<T, Policy>::Del(std::string_view key, uint64_t hash) {
   std::lock_guard<std::mutex> guard(mutex_);
-  auto found = map_.find(key);
+  Expire();
+  auto found = map_.find({key, hash});
   if (found == map_.end()) return nullptr;
-  std::shared_ptr<PairType> value = *(found->second);
-  list_.erase(found->second);
-  map_.erase(found);
+  PairPtr value = found->second->pair;
+  Erase(found);
   return value;
 }
+template<typename T, typename Policy>
+size_t PolicyCache<T, Policy>::TotalCharge() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return usage_;
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::set_capacity(size_t capacity) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  capacity_ = capacity;
+  policy_.set_capacity(capacity);
+  Expire();
+  Evict();
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::Release(const PairPtr &pair, uint64_t hash) {
+  auto found = map_.find({pair->first, hash});
+  // the entry was erased or replaced since
+  if (found == map_.end() || found->second->pair != pair) return;
+  if (--found->second->refs == 0) {
+    policy_.Unpin(&in_use_, found->second);
+    Evict();
+  }
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::Erase(typename MapType::iterator found) {
+  auto it = found->second;
+  // the key of the table views the pair of the entry, drop it first
+  map_.erase(found);
+  expiration_.Cancel(&*it);
+  usage_ -= it->charge;
+  if (it->refs == 0) {
+    policy_.Erase(it);
+  } else {
+    in_use_.erase(it);
+  }
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::Evict() {
+  while (usage_ > capacity_ && !policy_.Empty()) {
+    auto victim = policy_.Victim();
+    auto victim_slot = map_.find({victim->pair->first, victim->hash});
+    assert(victim_slot != map_.end() && victim_slot->second == victim);
+    Erase(victim_slot);
+  }
+}
+template<typename T, typename Policy>
+void PolicyCache<T, Policy>::Expire() {
+  expiration_.Advance([this](TimerNode *node) {
+    auto *entry = static_cast<Entry *>(node);
+    Erase(map_.find({entry->pair->first, entry->hash}));
+  });
+}
 
 template<typename T>
-class SharedLRUCache : public Cache<T> {
+using LRUCache = PolicyCache<T, LRUPolicy<T>>;
+template<typename T>
+using TinyLFUCache = PolicyCache<T, TinyLFUPolicy<T>>;
+
+// CLOCK approximation of LRU for read-mostly use. A hit only sets the
+// reference bit of its entry, under a shared lock, so readers never wait
+// for each other, unlike the exclusive mutex of LRUCache. They still write
+// the word of the lock, and the count of a pair in copying its handle, so
+// reads of one shard, or of a hot key, bounce these lines between cores.
+// Writers take the lock exclusively and sweep the hand over the ring:
+// referenced entries get a second chance, the first one not referenced
+// goes. Handles keep a pair alive past eviction, but do not pin its entry,
+// which is evicted as if unused.
+template<typename T>
+class ClockCache : public Cache<T> {
  public:
   using PairType = typename Cache<T>::PairType;
   using PairPtr = typename Cache<T>::PairPtr;
   using DeleterType = typename Cache<T>::DeleterType;
+  using Duration = typename Cache<T>::Duration;
+
+  explicit ClockCache(size_t capacity) :
+      ClockCache(capacity, std::default_delete<PairType>()) {}
+  // entries expire by clock
+  ClockCache(size_t capacity, DeleterType deleter,
+             CacheClock clock = std::chrono::steady_clock::now) :
+      Cache<T>(deleter), capacity_(capacity), usage_(), hand_(ring_.end()),
+      expiration_(std::move(clock)) {}
+  ~ClockCache() override = default;
+  using Cache<T>::Put;
+  using Cache<T>::Get;
+  using Cache<T>::Del;
+  void Put(std::string_view key, T value, size_t charge, Duration ttl,
+           uint64_t hash) override;
+  // an expired entry is a miss, left to the next writer to reclaim
+  PairPtr Get(std::string_view key, uint64_t hash) override;
+  using Cache<T>::Insert;
+  PairPtr Insert(std::string_view key, T value, size_t charge, Duration ttl,
+                 uint64_t hash) override;
+  PairPtr Del(std::string_view key, uint64_t hash) override;
+  std::vector<PairPtr> MultiGet(
+      std::span<const std::string_view> keys) override;
+  using Cache<T>::MultiPut;
+  void MultiPut(std::span<const std::pair<std::string_view, T>> pairs,
+                std::span<const size_t> charges, Duration ttl) override;
+  size_t TotalCharge() override;
+  void set_capacity(size_t capacity);
+
+  // batches of ShardedCache, see PolicyCache
+  void MultiGet(std::span<const std::string_view> keys,
+                std::span<const uint64_t> hashes,
+                std::span<const size_t> indices, std::span<PairPtr> values);
+  void MultiPut(std::span<const std::pair<std::string_view, T>> pairs,
+                std::span<const size_t> charges, Duration ttl,
+                std::span<const uint64_t> hashes,
+                std::span<const size_t> indices);
 
-  explicit SharedLRUCache(size_t capacity);
-  SharedLRUCache(size_t capacity, DeleterType deleter);
-  ~SharedLRUCache() override = default;
-  void Put(const std::string &key, T value) override;
-  PairPtr Get(const std::string &key) override;
-  PairPtr Del(const std::string &key) override;
  private:
-  static constexpr size_t kNumShardBits = 4u;
-  static constexpr size_t kNumShards = 1u << kNumShardBits;
+  struct Entry : TimerNode {
+    Entry(PairPtr pair, uint64_t hash, size_t charge) :
+        pair(std::move(pair)), hash(hash), charge(charge), referenced(false),
+        expiry() {}
 
-  static size_t ShardHash(const std::string &key);
+    PairPtr pair;
+    uint64_t hash;
+    size_t charge;
+    // set by readers holding the shared lock
+    std::atomic<bool> referenced;
+    // time_point::max() if never
+    std::chrono::steady_clock::time_point expiry;
+  };
+  using ListType = std::list<Entry>;
+  using MapType = std::unordered_map<
+      HashedKey, typename ListType::iterator, HashedKeyHash>;
 
-  size_t capacity_;
-  std::vector<LRUCache<T>> shard_;
+  // returns the new pair, which may be evicted already
+  PairPtr PutLocked(std::string_view key, T value, size_t charge,
+                    Duration ttl, uint64_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  PairPtr GetLocked(std::string_view key, uint64_t hash)
+      SHARED_LOCKS_REQUIRED(mutex_);
+  // drops the entry found from the cache, passing the hand over it
+  void Erase(typename MapType::iterator found)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // sweeps the hand while over capacity
+  void Evict() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // drops the entries expired
+  void Expire() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  size_t capacity_ GUARDED_BY(mutex_);
+  std::shared_mutex mutex_;
+  size_t usage_ GUARDED_BY(mutex_);
+  // the ring, entries are inserted right behind the hand
+  ListType ring_ GUARDED_BY(mutex_);
+  typename ListType::iterator hand_ GUARDED_BY(mutex_);
+  MapType map_ GUARDED_BY(mutex_);
+  Expiration expiration_ GUARDED_BY(mutex_);
 };
 template<typename T>
-SharedLRUCache<T>::SharedLRUCache(size_t capacity) :
-    capacity_(capacity) {
-  const size_t shard_capacity = (capacity + kNumShards - 1) / kNumShards;
-  shard_.resize(kNumShards, LRUCache<T>(shard_capacity));
+void ClockCache<T>::Put(std::string_view key, T value, size_t charge,
+                        Duration ttl, uint64_t hash) {
+  std::unique_lock<std::shared_mutex> guard(mutex_);
+  PutLocked(key, std::move(value), charge, ttl, hash);
+}
+template<typename T>
+typename ClockCache<T>::PairPtr ClockCache<T>::Get(
+    std::string_view key, uint64_t hash) {
+  std::shared_lock<std::shared_mutex> guard(mutex_);
+  return GetLocked(key, hash);
+}
+template<typename T>
+typename ClockCache<T>::PairPtr ClockCache<T>::Insert(
+    std::string_view key, T value, size_t charge, Duration ttl,
+    uint64_t hash) {
+  std::unique_lock<std::shared_mutex> guard(mutex_);
+  return PutLocked(key, std::move(value), charge, ttl, hash);
+}
+template<typename T>
+std::vector<typename ClockCache<T>::PairPtr> ClockCache<T>::MultiGet(
+    std::span<const std::string_view> keys) {
+  std::vector<uint64_t> hashes;
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    hashes.push_back(Hash(keys[i]));
+    indices.push_back(i);
+  }
+  std::vector<PairPtr> values(keys.size());
+  MultiGet(keys, hashes, indices, values);
+  return values;
 }
 template<typename T>
-SharedLRUCache<T>::SharedLRUCache(size_t capacity, DeleterType deleter) :
-    capacity_(capacity) {
-  const size_t shard_capacity = (capacity + kNumShards - 1) / kNumShards;
-  shard_.resize(kNumShards, LRUCache<T>(shard_capacity, deleter));
+void ClockCache<T>::MultiPut(
+    std::span<const std::pair<std::string_view, T>> pairs,
+    std::span<const size_t> charges, Duration ttl) {
+  assert(charges.empty() || charges.size() == pairs.size());
+  std::vector<uint64_t> hashes;
+  std::vector<size_t> indices;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    hashes.push_back(Hash(pairs[i].first));
+    indices.push_back(i);
+  }
+  MultiPut(pairs, charges, ttl, hashes, indices);
 }
 template<typename T>
-void SharedLRUCache<T>::Put(const std::string &key, T value) {
-  const size_t slot = ShardHash(key) & (kNumShards - 1);
-  shard_[slot].Put(key, std::move(value));
+void ClockCache<T>::MultiGet(
+    std::span<const std::string_view> keys, std::span<const uint64_t> hashes,
+    std::span<const size_t> indices, std::span<PairPtr> values) {
+  std::shared_lock<std::shared_mutex> guard(mutex_);
+  for (size_t i : indices) {
+    WarmBucket(map_, {keys[i], hashes[i]});
+  }
+  for (size_t i : indices) {
+    values[i] = GetLocked(keys[i], hashes[i]);
+  }
 }
 template<typename T>
-typename SharedLRUCache<T>::PairPtr
-SharedLRUCache<T>::Get(const std::string &key) {
-  const size_t slot = ShardHash(key) & (kNumShards - 1);
-  return shard_[slot].Get(key);
+void ClockCache<T>::MultiPut(
+    std::span<const std::pair<std::string_view, T>> pairs,
+    std::span<const size_t> charges, Duration ttl,
+    std::span<const uint64_t> hashes, std::span<const size_t> indices) {
+  std::unique_lock<std::shared_mutex> guard(mutex_);
+  for (size_t i : indices) {
+    WarmBucket(map_, {pairs[i].first, hashes[i]});
+  }
+  for (size_t i : indices) {
+    PutLocked(pairs[i].first, pairs[i].second,
+              charges.empty() ? 1 : charges[i], ttl, hashes[i]);
+  }
+}
+template<typename T>
+typename ClockCache<T>::PairPtr ClockCache<T>::PutLocked(
+    std::string_view key, T value, size_t charge, Duration ttl,
+    uint64_t hash) {
+  Expire();
+  if (auto found = map_.find({key, hash}); found != map_.end()) {
+    Erase(found);
+  }
+  auto it = ring_.emplace(
+      hand_, PairPtr(new PairType(key, std::move(value)), this->deleter_),
+      hash, charge);
+  it->expiry = expiration_.Schedule(&*it, ttl);
+  usage_ += charge;
+  map_.emplace(HashedKey{it->pair->first, hash}, it);
+  PairPtr pair = it->pair;
+  Evict();
+  return pair;
+}
+template<typename T>
+typename ClockCache<T>::PairPtr ClockCache<T>::GetLocked(
+    std::string_view key, uint64_t hash) {
+  auto found = map_.find({key, hash});
+  if (found == map_.end()) return nullptr;
+  Entry &entry = *found->second;
+  if (expiration_.Expired(entry.expiry)) return nullptr;
+  // skip the store when set already, keeping the cache line shared
+  if (!entry.referenced.load(std::memory_order_relaxed)) {
+    entry.referenced.store(true, std::memory_order_relaxed);
+  }
+  return entry.pair;
+}
+template<typename T>
+typename ClockCache<T>::PairPtr ClockCache<T>::Del(
+    std::string_view key, uint64_t hash) {
+  std::unique_lock<std::shared_mutex> guard(mutex_);
+  Expire();
+  auto found = map_.find({key, hash});
+  if (found == map_.end()) return nullptr;
+  PairPtr value = found->second->pair;
+  Erase(found);
+  return value;
+}
+template<typename T>
+size_t ClockCache<T>::TotalCharge() {
+  std::shared_lock<std::shared_mutex> guard(mutex_);
+  return usage_;
+}
+template<typename T>
+void ClockCache<T>::set_capacity(size_t capacity) {
+  std::unique_lock<std::shared_mutex> guard(mutex_);
+  capacity_ = capacity;
+  Expire();
+  Evict();
+}
+template<typename T>
+void ClockCache<T>::Erase(typename MapType::iterator found) {
+  auto it = found->second;
+  // the key of the table views the pair of the entry, drop it first
+  map_.erase(found);
+  expiration_.Cancel(&*it);
+  if (hand_ == it) ++hand_;
+  usage_ -= it->charge;
+  ring_.erase(it);
 }
 template<typename T>
-typename SharedLRUCache<T>::PairPtr
-SharedLRUCache<T>::Del(const std::string &key) {
-  const size_t slot = ShardHash(key) & (kNumShards - 1);
-  return shard_[slot].Del(key);
+void ClockCache<T>::Evict() {
+  while (usage_ > capacity_ && !ring_.empty()) {
+    if (hand_ == ring_.end()) hand_ = ring_.begin();
+    if (hand_->referenced.load(std::memory_order_relaxed)) {
+      // second chance
+      hand_->referenced.store(false, std::memory_order_relaxed);
+      ++hand_;
+      continue;
+    }
+    Erase(map_.find({hand_->pair->first, hand_->hash}));
+  }
 }
 template<typename T>
-size_t SharedLRUCache<T>::ShardHash(const std::string &key) {
-  size_t hash = 0;
-  for (char ch : key) {
-    hash = hash * 101 + ch;
+void ClockCache<T>::Expire() {
+  expiration_.Advance([this](TimerNode *node) {
+    auto *entry = static_cast<Entry *>(node);
+    Erase(map_.find({entry->pair->first, entry->hash}));
+  });
+}
+
+// Spreads keys over a power of two Shard caches, such as PolicyCache or
+// ClockCache, each with its own mutex and an even part of the capacity. The
+// high bits of Hash pick the shard. Shards are aligned to cache lines, so
+// the mutexes of neighbours do not false-share.
+template<typename T, typename Shard>
+class ShardedCache : public Cache<T> {
+ public:
+  using PairType = typename Cache<T>::PairType;
+  using PairPtr = typename Cache<T>::PairPtr;
+  using DeleterType = typename Cache<T>::DeleterType;
+  using Duration = typename Cache<T>::Duration;
+
+  // 2^num_shard_bits shards, a count fit for the hardware concurrency if
+  // negative. Bits above kMaxShardBits are clamped to it. Every shard
+  // expires its entries by clock
+  explicit ShardedCache(size_t capacity, int num_shard_bits = -1);
+  ShardedCache(size_t capacity, DeleterType deleter, int num_shard_bits = -1,
+               CacheClock clock = std::chrono::steady_clock::now);
+  ~ShardedCache() override = default;
+  using Cache<T>::Put;
+  using Cache<T>::Get;
+  using Cache<T>::Del;
+  void Put(std::string_view key, T value, size_t charge, Duration ttl,
+           uint64_t hash) override;
+  PairPtr Get(std::string_view key, uint64_t hash) override;
+  using Cache<T>::Insert;
+  PairPtr Insert(std::string_view key, T value, size_t charge, Duration ttl,
+                 uint64_t hash) override;
+  // loads in the shard of key, so that misses of other shards do not wait
+  using Cache<T>::GetOrLoad;
+  PairPtr GetOrLoad(std::string_view key, const std::function<T()> &loader,
+                    size_t charge, Duration ttl, uint64_t hash) override;
+  PairPtr Del(std::string_view key, uint64_t hash) override;
+  // group the keys by shard, and run every group under one lock
+  std::vector<PairPtr> MultiGet(
+      std::span<const std::string_view> keys) override;
+  using Cache<T>::MultiPut;
+  void MultiPut(std::span<const std::pair<std::string_view, T>> pairs,
+                std::span<const size_t> charges, Duration ttl) override;
+  size_t TotalCharge() override;
+
+  std::vector<size_t> ShardCharges() override;
+
+  [[nodiscard]] size_t num_shards() const { return shard_.size(); }
+
+  static constexpr int kMaxShardBits = impl::kMaxShardBits;
+  static int DefaultShardBits() { return impl::DefaultShardBits(); }
+
+ private:
+  struct alignas(kCacheLineSize) AlignedShard : Shard {
+    using Shard::Shard;
+  };
+
+  [[nodiscard]] size_t ShardIndex(uint64_t hash) const {
+    return impl::ShardIndex(hash, num_shard_bits_);
+  }
+  [[nodiscard]] Shard &ShardOf(uint64_t hash) {
+    return *shard_[ShardIndex(hash)];
+  }
+  // sorts the indices of hashes by shard, the ones of shard i are in
+  // indices[offsets[i], offsets[i + 1])
+  void GroupByShard(std::span<const uint64_t> hashes,
+                    std::vector<size_t> *indices,
+                    std::vector<size_t> *offsets) const;
+
+  size_t capacity_;
+  int num_shard_bits_;
+  // shards hold a mutex, so they stay put
+  std::vector<std::unique_ptr<AlignedShard>> shard_;
+};
+template<typename T, typename Shard>
+ShardedCache<T, Shard>::ShardedCache(size_t capacity, int num_shard_bits) :
+    ShardedCache(capacity, std::default_delete<PairType>(), num_shard_bits) {}
+template<typename T, typename Shard>
+ShardedCache<T, Shard>::ShardedCache(
+    size_t capacity, DeleterType deleter, int num_shard_bits,
+    CacheClock clock) :
+    capacity_(capacity),
+    num_shard_bits_(ShardBits(num_shard_bits)) {
+  const size_t num_shards = size_t{1} << num_shard_bits_;
+  const size_t shard_capacity = (capacity + num_shards - 1) / num_shards;
+  for (size_t i = 0; i < num_shards; ++i) {
+    shard_.push_back(
+        std::make_unique<AlignedShard>(shard_capacity, deleter, clock));
+  }
+}
+template<typename T, typename Shard>
+void ShardedCache<T, Shard>::Put(std::string_view key, T value,
+                                 size_t charge, Duration ttl, uint64_t hash) {
+  ShardOf(hash).Put(key, std::move(value), charge, ttl, hash);
+}
+template<typename T, typename Shard>
+typename ShardedCache<T, Shard>::PairPtr
+ShardedCache<T, Shard>::Get(std::string_view key, uint64_t hash) {
+  return ShardOf(hash).Get(key, hash);
+}
+template<typename T, typename Shard>
+typename ShardedCache<T, Shard>::PairPtr ShardedCache<T, Shard>::Insert(
+    std::string_view key, T value, size_t charge, Duration ttl,
+    uint64_t hash) {
+  return ShardOf(hash).Insert(key, std::move(value), charge, ttl, hash);
+}
+template<typename T, typename Shard>
+typename ShardedCache<T, Shard>::PairPtr ShardedCache<T, Shard>::GetOrLoad(
+    std::string_view key, const std::function<T()> &loader, size_t charge,
+    Duration ttl, uint64_t hash) {
+  return ShardOf(hash).GetOrLoad(key, loader, charge, ttl, hash);
+}
+template<typename T, typename Shard>
+typename ShardedCache<T, Shard>::PairPtr
+ShardedCache<T, Shard>::Del(std::string_view key, uint64_t hash) {
+  return ShardOf(hash).Del(key, hash);
+}
+template<typename T, typename Shard>
+std::vector<typename ShardedCache<T, Shard>::PairPtr>
+ShardedCache<T, Shard>::MultiGet(std::span<const std::string_view> keys) {
+  std::vector<uint64_t> hashes;
+  for (std::string_view key : keys) {
+    hashes.push_back(Hash(key));
+  }
+  std::vector<size_t> indices, offsets;
+  GroupByShard(hashes, &indices, &offsets);
+  std::vector<PairPtr> values(keys.size());
+  for (size_t i = 0; i < shard_.size(); ++i) {
+    if (offsets[i] == offsets[i + 1]) continue;
+    shard_[i]->MultiGet(
+        keys, hashes,
+        std::span(indices).subspan(offsets[i], offsets[i + 1] - offsets[i]),
+        values);
+  }
+  return values;
+}
+template<typename T, typename Shard>
+void ShardedCache<T, Shard>::MultiPut(
+    std::span<const std::pair<std::string_view, T>> pairs,
+    std::span<const size_t> charges, Duration ttl) {
+  assert(charges.empty() || charges.size() == pairs.size());
+  std::vector<uint64_t> hashes;
+  for (const auto &pair : pairs) {
+    hashes.push_back(Hash(pair.first));
+  }
+  std::vector<size_t> indices, offsets;
+  GroupByShard(hashes, &indices, &offsets);
+  for (size_t i = 0; i < shard_.size(); ++i) {
+    if (offsets[i] == offsets[i + 1]) continue;
+    shard_[i]->MultiPut(
+        pairs, charges, ttl, hashes,
+        std::span(indices).subspan(offsets[i], offsets[i + 1] - offsets[i]));
+  }
+}
+template<typename T, typename Shard>
+void ShardedCache<T, Shard>::GroupByShard(
+    std::span<const uint64_t> hashes, std::vector<size_t> *indices,
+    std::vector<size_t> *offsets) const {
+  // counting sort, keeping the order of the keys of a shard
+  offsets->assign(shard_.size() + 1, 0);
+  for (uint64_t hash : hashes) {
+    ++(*offsets)[ShardIndex(hash) + 1];
+  }
+  for (size_t i = 0; i < shard_.size(); ++i) {
+    (*offsets)[i + 1] += (*offsets)[i];
+  }
+  std::vector<size_t> next(offsets->begin(), offsets->end() - 1);
+  indices->resize(hashes.size());
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    (*indices)[next[ShardIndex(hashes[i])]++] = i;
+  }
+}
+template<typename T, typename Shard>
+size_t ShardedCache<T, Shard>::TotalCharge() {
+  size_t total = 0;
+  for (auto &shard : shard_) {
+    total += shard->TotalCharge();
+  }
+  return total;
+}
+template<typename T, typename Shard>
+std::vector<size_t> ShardedCache<T, Shard>::ShardCharges() {
+  std::vector<size_t> charges;
+  for (auto &shard : shard_) {
+    charges.push_back(shard->TotalCharge());
   }
-  return hash;
+  return charges;
 }
 
+template<typename T>
+using SharedLRUCache = ShardedCache<T, LRUCache<T>>;
+
 }  // namespace impl
 
+// capacity is a budget of total charge, which only pinned entries exceed.
+// The cache has 2^num_shard_bits shards, or a count fit for the hardware
+// concurrency if negative. There are at most 64 shards: num_shard_bits
+// above 6 are clamped to 6.
+template<typename T>
+std::unique_ptr<Cache<T>> NewLRUCache(size_t capacity, int num_shard_bits) {
+  return std::unique_ptr<Cache<T>>(
+      new impl::SharedLRUCache<T>(capacity, num_shard_bits));
+}
+template<typename T>
+std::unique_ptr<Cache<T>> NewLRUCache(
+    size_t capacity, std::function<void(std::pair<std::string, T> *)> deleter,
+    int num_shard_bits) {
+  return std::unique_ptr<Cache<T>>(new impl::SharedLRUCache<T>(
+      capacity, std::move(deleter), num_shard_bits));
+}
+// like NewLRUCache, evicting by W-TinyLFU, which resists scans
+template<typename T>
+std::unique_ptr<Cache<T>> NewTinyLFUCache(
+    size_t capacity, int num_shard_bits = -1) {
+  return std::unique_ptr<Cache<T>>(
+      new impl::ShardedCache<T, impl::TinyLFUCache<T>>(
+          capacity, num_shard_bits));
+}
+template<typename T>
+std::unique_ptr<Cache<T>> NewTinyLFUCache(
+    size_t capacity, std::function<void(std::pair<std::string, T> *)> deleter,
+    int num_shard_bits = -1) {
+  return std::unique_ptr<Cache<T>>(
+      new impl::ShardedCache<T, impl::TinyLFUCache<T>>(
+          capacity, std::move(deleter), num_shard_bits));
+}
+// like NewLRUCache, evicting by CLOCK, whose reads share the lock
+template<typename T>
+std::unique_ptr<Cache<T>> NewClockCache(
+    size_t capacity, int num_shard_bits = -1) {
+  return std::unique_ptr<Cache<T>>(
+      new impl::ShardedCache<T, impl::ClockCache<T>>(
+          capacity, num_shard_bits));
+}
 template<typename T>
-std::unique_ptr<Cache<T>> NewLRUCache(size_t capacity) {
-  return std::unique_ptr<Cache<T>>(new impl::SharedLRUCache<T>(capacity));
+std::unique_ptr<Cache<T>> NewClockCache(
+    size_t capacity, std::function<void(std::pair<std::string, T> *)> deleter,
+    int num_shard_bits = -1) {
+  return std::unique_ptr<Cache<T>>(
+      new impl::ShardedCache<T, impl::ClockCache<T>>(
+          capacity, std::move(deleter), num_shard_bits));
 }
 
 }  // namespace yaldb
@@ -0,0 +1,323 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef YALDB_CACHE_POLICY_H_
+#define YALDB_CACHE_POLICY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "yaldb/timing_wheel.h"
+
+namespace yaldb {
+
+namespace impl {
+
+// room for the control block of the handles on an entry, see PolicyCache:
+// a vtable pointer, two counts and the pointer owned, then the releaser of
+// the handle, two shared_ptr and a hash, and its allocator, a shared_ptr.
+// HandleAllocator asserts the real one fits
+struct HandleStorage {
+  static constexpr size_t kSize = 2 * sizeof(void *) + 2 * sizeof(int64_t) +
+      3 * sizeof(std::shared_ptr<void>) + sizeof(uint64_t);
+  alignas(std::max_align_t) std::byte buffer[kSize];
+  // a control block lives in buffer
+  std::atomic<bool> busy = false;
+};
+
+// the timer of an entry which expires is scheduled on the wheel of its shard
+template<typename T>
+struct CacheEntry : TimerNode {
+  std::shared_ptr<std::pair<std::string, T>> pair;
+  // yaldb::Hash of the key
+  uint64_t hash;
+  size_t charge;
+  // handles alive, the entry is pinned out of the policy while nonzero
+  size_t refs;
+  // the handle shared by the readers of an entry in use
+  std::weak_ptr<std::pair<std::string, T>> handle;
+  // shared with the handles, which keep their control blocks in it. Made
+  // on the first pin, so that entries never read go without
+  std::shared_ptr<HandleStorage> storage;
+  // where the policy keeps the entry, private to the policy
+  uint8_t region;
+  // time_point::max() if never
+  std::chrono::steady_clock::time_point expiry;
+};
+
+// An eviction policy owns the unpinned entries of a cache shard and picks
+// which one goes next. Entries move between the lists of the shard and of
+// the policy by splicing, and the shard calls, under its mutex:
+//   Policy(size_t capacity), set_capacity(size_t capacity)
+//   Record(hash): the key hashed is accessed, whether it is cached or not
+//   Add(list, it): takes a new entry out of list
+//   Pin(it, list): hands an entry of the policy over to list
+//   Unpin(list, it): takes back a pinned entry, which was just used
+//   Erase(it): destroys an entry of the policy
+//   Empty(), Victim(): the entry to evict next, only if not empty
+
+// least recently used first out
+template<typename T>
+class LRUPolicy {
+ public:
+  using Entry = CacheEntry<T>;
+  using List = std::list<Entry>;
+  using Iterator = typename List::iterator;
+
+  explicit LRUPolicy(size_t) {}
+  void set_capacity(size_t) {}
+
+  void Record(uint64_t) {}
+  void Add(List *list, Iterator it) { lru_.splice(lru_.begin(), *list, it); }
+  void Pin(Iterator it, List *list) { list->splice(list->begin(), lru_, it); }
+  void Unpin(List *list, Iterator it) { Add(list, it); }
+  void Erase(Iterator it) { lru_.erase(it); }
+  [[nodiscard]] bool Empty() const { return lru_.empty(); }
+  Iterator Victim() { return std::prev(lru_.end()); }
+
+ private:
+  // most recently used first
+  List lru_;
+};
+
+// Count-min sketch estimating how often keys were seen, with 4 rows of
+// 4-bit counters saturating at 15, two to a byte. Every counter is halved
+// once the additions reach 10 times the width, so that past popularity
+// fades.
+class FrequencySketch {
+ public:
+  FrequencySketch() : width_(0), additions_(0) { EnsureCapacity(1); }
+
+  // widens the rows to fit entries keys. A counter of the wider rows starts
+  // from the one it was split from, sharing the low bits of its index, so
+  // the estimates stay upper bounds
+  void EnsureCapacity(size_t entries) {
+    size_t width = kMinWidth;
+    while (width < entries) {
+      width *= 2;
+    }
+    if (width <= width_) return;
+    std::vector<uint8_t> table(width * kDepth / 2, 0);
+    for (size_t row = 0; width_ > 0 && row < kDepth; ++row) {
+      for (size_t i = 0; i < width; ++i) {
+        const size_t index = row * width + i;
+        table[index / 2] |= Counter(row * width_ + (i & (width_ - 1)))
+            << Shift(index);
+      }
+    }
+    width_ = width;
+    table_ = std::move(table);
+  }
+  void Increment(size_t hash) {
+    bool added = false;
+    for (size_t row = 0; row < kDepth; ++row) {
+      const size_t index = Index(hash, row);
+      if (Counter(index) < kMaxCount) {
+        table_[index / 2] += 1 << Shift(index);
+        added = true;
+      }
+    }
+    if (added && ++additions_ >= width_ * kSampleFactor) {
+      Age();
+    }
+  }
+  [[nodiscard]] uint8_t Frequency(size_t hash) const {
+    uint8_t frequency = kMaxCount;
+    for (size_t row = 0; row < kDepth; ++row) {
+      frequency = std::min(frequency, Counter(Index(hash, row)));
+    }
+    return frequency;
+  }
+
+ private:
+  static constexpr size_t kDepth = 4;
+  static constexpr size_t kMinWidth = 16;
+  static constexpr size_t kSampleFactor = 10;
+  static constexpr uint8_t kMaxCount = 15;
+  static_assert(kMinWidth * kDepth % 2 == 0);
+
+  // a differently seeded mix of hash for every row
+  size_t Index(size_t hash, size_t row) const {
+    uint64_t h = hash + (row + 1) * 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return row * width_ + (h & (width_ - 1));
+  }
+  // the counter at index lives in the low half of byte index / 2 if index
+  // is even, in the high half if odd
+  static int Shift(size_t index) { return index % 2 * 4; }
+  [[nodiscard]] uint8_t Counter(size_t index) const {
+    return table_[index / 2] >> Shift(index) & kMaxCount;
+  }
+  void Age() {
+    // halves both counters of a byte, dropping what crosses the halves
+    for (uint8_t &counters : table_) {
+      counters = counters >> 1 & 0x77;
+    }
+    additions_ /= 2;
+  }
+
+  size_t width_;
+  size_t additions_;
+  // counters of row r at r * width_ onwards, two to a byte
+  std::vector<uint8_t> table_;
+};
+
+// W-TinyLFU: new entries enter a small LRU window, holding 1% of the
+// capacity. The entry pushed out of the window is admitted to the main
+// region only if the sketch saw its key more often than the key of the
+// main victim, so a scan of keys seen once cannot flush the main region.
+// The main region is segmented: entries used again move from probation to
+// protected, 80% of the main region, whose overflow falls back to
+// probation. Victims come from probation first.
+template<typename T>
+class TinyLFUPolicy {
+ public:
+  using Entry = CacheEntry<T>;
+  using List = std::list<Entry>;
+  using Iterator = typename List::iterator;
+
+  explicit TinyLFUPolicy(size_t capacity) : entries_(0), charges_() {
+    set_capacity(capacity);
+  }
+  void set_capacity(size_t capacity);
+
+  void Record(uint64_t hash) { sketch_.Increment(hash); }
+  void Add(List *list, Iterator it);
+  void Pin(Iterator it, List *list);
+  void Unpin(List *list, Iterator it);
+  void Erase(Iterator it);
+  [[nodiscard]] bool Empty() const { return entries_ == 0; }
+  Iterator Victim();
+
+ private:
+  enum Region : uint8_t { kWindow, kProbation, kProtected, kNumRegions };
+
+  // splices it from list to the front of region
+  void Enter(Region region, List *list, Iterator it);
+  // moves an entry of the policy to the front of region
+  void Move(Iterator it, Region region) {
+    charges_[it->region] -= it->charge;
+    --entries_;
+    Enter(region, &lists_[it->region], it);
+  }
+  void DemoteProtected();
+  // the oldest entry of the main region, or end
+  Iterator MainVictim();
+
+  size_t window_capacity_;
+  size_t main_capacity_;
+  size_t protected_capacity_;
+  size_t entries_;
+  // most recently used first
+  List lists_[kNumRegions];
+  size_t charges_[kNumRegions];
+  FrequencySketch sketch_;
+};
+
+template<typename T>
+void TinyLFUPolicy<T>::set_capacity(size_t capacity) {
+  window_capacity_ = capacity / 100;
+  main_capacity_ = capacity - window_capacity_;
+  protected_capacity_ = main_capacity_ / 5 * 4;
+}
+template<typename T>
+void TinyLFUPolicy<T>::Add(List *list, Iterator it) {
+  Enter(kWindow, list, it);
+  // 16 counters a key, across the rows, keep collisions rare
+  sketch_.EnsureCapacity(entries_ * 4);
+  // the window overflows to the main region freely while it has room, the
+  // admission duel is left to Victim
+  List &window = lists_[kWindow];
+  while (charges_[kWindow] > window_capacity_ && window.size() > 1) {
+    Iterator candidate = std::prev(window.end());
+    if (charges_[kProbation] + charges_[kProtected] + candidate->charge >
+        main_capacity_) {
+      break;
+    }
+    Move(candidate, kProbation);
+  }
+}
+template<typename T>
+void TinyLFUPolicy<T>::Pin(Iterator it, List *list) {
+  charges_[it->region] -= it->charge;
+  --entries_;
+  list->splice(list->begin(), lists_[it->region], it);
+}
+template<typename T>
+void TinyLFUPolicy<T>::Unpin(List *list, Iterator it) {
+  if (it->region == kWindow) {
+    Enter(kWindow, list, it);
+  } else {
+    // used again, a probation entry earns protection
+    Enter(kProtected, list, it);
+    DemoteProtected();
+  }
+}
+template<typename T>
+void TinyLFUPolicy<T>::Erase(Iterator it) {
+  charges_[it->region] -= it->charge;
+  --entries_;
+  lists_[it->region].erase(it);
+}
+template<typename T>
+typename TinyLFUPolicy<T>::Iterator TinyLFUPolicy<T>::Victim() {
+  List &window = lists_[kWindow];
+  while (!window.empty() && charges_[kWindow] > window_capacity_) {
+    Iterator candidate = std::prev(window.end());
+    Iterator victim = MainVictim();
+    const bool has_room = charges_[kProbation] + charges_[kProtected] +
+        candidate->charge <= main_capacity_;
+    if (has_room) {
+      Move(candidate, kProbation);
+      continue;
+    }
+    if (victim == lists_[kProtected].end()) return candidate;
+    // the one seen less often goes, the candidate on a tie, so keys seen
+    // once never displace the main region
+    if (sketch_.Frequency(candidate->hash) <=
+        sketch_.Frequency(victim->hash)) {
+      return candidate;
+    }
+    Move(candidate, kProbation);
+    return victim;
+  }
+  // the overflow is in the main region, or pinned
+  Iterator victim = MainVictim();
+  return victim != lists_[kProtected].end() ? victim : std::prev(window.end());
+}
+template<typename T>
+void TinyLFUPolicy<T>::Enter(Region region, List *list, Iterator it) {
+  it->region = region;
+  charges_[region] += it->charge;
+  ++entries_;
+  lists_[region].splice(lists_[region].begin(), *list, it);
+}
+template<typename T>
+void TinyLFUPolicy<T>::DemoteProtected() {
+  List &protect = lists_[kProtected];
+  while (charges_[kProtected] > protected_capacity_ && protect.size() > 1) {
+    Move(std::prev(protect.end()), kProbation);
+  }
+}
+template<typename T>
+typename TinyLFUPolicy<T>::Iterator TinyLFUPolicy<T>::MainVictim() {
+  if (!lists_[kProbation].empty()) return std::prev(lists_[kProbation].end());
+  if (!lists_[kProtected].empty()) return std::prev(lists_[kProtected].end());
+  return lists_[kProtected].end();
+}
+
+}  // namespace impl
+
+}  // namespace yaldb
+
+#endif  // YALDB_CACHE_POLICY_H_
@@ -0,0 +1,423 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef YALDB_HANDLE_CACHE_H_
+#define YALDB_HANDLE_CACHE_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "yaldb/hash.h"
+#include "yaldb/shard.h"
+#include "yaldb/thread_annotation.h"
+
+namespace yaldb {
+
+namespace impl {
+
+// links of the circular LRU lists, the heads of which carry nothing else
+struct LRULinks {
+  LRULinks *next;
+  LRULinks *prev;
+};
+
+// An entry of HandleCache: the links of the hash chain and of the LRU
+// lists, the reference count, the value and the key bytes all live in one
+// allocation, with the key stored inline after the header.
+template<typename T>
+struct LRUHandle : LRULinks {
+  T value;
+  LRUHandle *next_hash;
+  size_t charge;
+  size_t key_length;
+  // one for the cache while in_cache, plus one per outstanding handle
+  uint32_t refs;
+  bool in_cache;
+  size_t hash;
+  char key_data[1];
+
+  LRUHandle(std::string_view key, size_t hash, T value, size_t charge) :
+      LRULinks{nullptr, nullptr}, value(std::move(value)),
+      next_hash(nullptr), charge(charge), key_length(key.size()), refs(1),
+      in_cache(false), hash(hash) {
+    std::memcpy(key_data, key.data(), key.size());
+  }
+
+  std::string_view key() const { return {key_data, key_length}; }
+
+  static LRUHandle *New(std::string_view key, size_t hash, T value,
+                        size_t charge) {
+    void *mem = ::operator new(sizeof(LRUHandle) - 1 + key.size());
+    return new(mem) LRUHandle(key, hash, std::move(value), charge);
+  }
+  static void Delete(LRUHandle *handle) {
+    handle->~LRUHandle();
+    ::operator delete(handle);
+  }
+};
+
+// Chained hash table of handles linked through next_hash, so that it
+// allocates nothing per entry. Grows to keep chains about one long.
+template<typename T>
+class HandleTable {
+ public:
+  using Handle = LRUHandle<T>;
+
+  HandleTable() : length_(0), elems_(0), list_(nullptr) { Resize(); }
+  HandleTable(const HandleTable &) = delete;
+  HandleTable &operator=(const HandleTable &) = delete;
+  ~HandleTable() { delete[] list_; }
+
+  Handle *Lookup(std::string_view key, size_t hash) {
+    return *FindPointer(key, hash);
+  }
+  // returns the handle of the same key that was replaced, if any
+  Handle *Insert(Handle *handle);
+  Handle *Remove(std::string_view key, size_t hash);
+
+ private:
+  // the slot pointing to the handle of key, or the null slot ending its
+  // chain
+  Handle **FindPointer(std::string_view key, size_t hash);
+  void Resize();
+
+  size_t length_;
+  size_t elems_;
+  Handle **list_;
+};
+
+template<typename T>
+typename HandleTable<T>::Handle *HandleTable<T>::Insert(Handle *handle) {
+  Handle **ptr = FindPointer(handle->key(), handle->hash);
+  Handle *old = *ptr;
+  handle->next_hash = old == nullptr ? nullptr : old->next_hash;
+  *ptr = handle;
+  if (old == nullptr && ++elems_ > length_) {
+    Resize();
+  }
+  return old;
+}
+template<typename T>
+typename HandleTable<T>::Handle *HandleTable<T>::Remove(
+    std::string_view key, size_t hash) {
+  Handle **ptr = FindPointer(key, hash);
+  Handle *result = *ptr;
+  if (result != nullptr) {
+    *ptr = result->next_hash;
+    --elems_;
+  }
+  return result;
+}
+template<typename T>
+typename HandleTable<T>::Handle **HandleTable<T>::FindPointer(
+    std::string_view key, size_t hash) {
+  Handle **ptr = &list_[hash & (length_ - 1)];
+  while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key())) {
+    ptr = &(*ptr)->next_hash;
+  }
+  return ptr;
+}
+template<typename T>
+void HandleTable<T>::Resize() {
+  size_t new_length = 4;
+  while (new_length < elems_) {
+    new_length *= 2;
+  }
+  auto **new_list = new Handle *[new_length]();
+  for (size_t i = 0; i < length_; ++i) {
+    for (Handle *handle = list_[i]; handle != nullptr;) {
+      Handle *next = handle->next_hash;
+      Handle **slot = &new_list[handle->hash & (new_length - 1)];
+      handle->next_hash = *slot;
+      *slot = handle;
+      handle = next;
+    }
+  }
+  delete[] list_;
+  list_ = new_list;
+  length_ = new_length;
+}
+
+// One shard of HandleCache. Entries in the cache sit on exactly one of two
+// circular lists: lru_ while nobody holds a handle to them, from which
+// eviction takes the oldest in O(1), and in_use_ while they are pinned.
+template<typename T>
+class HandleCacheShard {
+ public:
+  using Handle = LRUHandle<T>;
+
+  HandleCacheShard() : capacity_(0), usage_(0) {
+    lru_.next = lru_.prev = &lru_;
+    in_use_.next = in_use_.prev = &in_use_;
+  }
+  HandleCacheShard(const HandleCacheShard &) = delete;
+  HandleCacheShard &operator=(const HandleCacheShard &) = delete;
+  ~HandleCacheShard();
+
+  void set_capacity(size_t capacity) { capacity_ = capacity; }
+
+  Handle *Insert(std::string_view key, size_t hash, T value, size_t charge);
+  Handle *Lookup(std::string_view key, size_t hash);
+  void Release(Handle *handle);
+  void Erase(std::string_view key, size_t hash);
+  void Prune();
+  size_t TotalCharge() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return usage_;
+  }
+
+ private:
+  static Handle *AsHandle(LRULinks *links) {
+    return static_cast<Handle *>(links);
+  }
+  static void ListRemove(Handle *handle);
+  static void ListAppend(LRULinks *list, Handle *handle);
+  void Ref(Handle *handle) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void Unref(Handle *handle) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // drops handle, already removed from the table, from the cache
+  void FinishErase(Handle *handle) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // drops the oldest unpinned entries while over capacity
+  void Evict() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  size_t capacity_;
+  std::mutex mutex_;
+  size_t usage_ GUARDED_BY(mutex_);
+  // entries with refs == 1 and in_cache, oldest first
+  LRULinks lru_ GUARDED_BY(mutex_);
+  // entries with refs >= 2 and in_cache, in no particular order
+  LRULinks in_use_ GUARDED_BY(mutex_);
+  HandleTable<T> table_ GUARDED_BY(mutex_);
+};
+
+template<typename T>
+HandleCacheShard<T>::~HandleCacheShard() {
+  // every handle must have been released
+  assert(in_use_.next == &in_use_);
+  for (LRULinks *links = lru_.next; links != &lru_;) {
+    Handle *handle = AsHandle(links);
+    links = links->next;
+    assert(handle->in_cache && handle->refs == 1);
+    Handle::Delete(handle);
+  }
+}
+template<typename T>
+typename HandleCacheShard<T>::Handle *HandleCacheShard<T>::Insert(
+    std::string_view key, size_t hash, T value, size_t charge) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  Handle *handle = Handle::New(key, hash, std::move(value), charge);
+  // the handle returned to the caller
+  handle->refs = 1;
+  if (capacity_ > 0) {
+    ++handle->refs;
+    handle->in_cache = true;
+    ListAppend(&in_use_, handle);
+    usage_ += charge;
+    if (Handle *old = table_.Insert(handle); old != nullptr) {
+      FinishErase(old);
+    }
+  }
+  // a capacity of 0 turns caching off, the entry lives as long as the
+  // handle
+  Evict();
+  return handle;
+}
+template<typename T>
+typename HandleCacheShard<T>::Handle *HandleCacheShard<T>::Lookup(
+    std::string_view key, size_t hash) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  Handle *handle = table_.Lookup(key, hash);
+  if (handle != nullptr) {
+    Ref(handle);
+  }
+  return handle;
+}
+template<typename T>
+void HandleCacheShard<T>::Release(Handle *handle) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  Unref(handle);
+}
+template<typename T>
+void HandleCacheShard<T>::Erase(std::string_view key, size_t hash) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (Handle *handle = table_.Remove(key, hash); handle != nullptr) {
+    FinishErase(handle);
+  }
+}
+template<typename T>
+void HandleCacheShard<T>::Prune() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  while (lru_.next != &lru_) {
+    Handle *handle = AsHandle(lru_.next);
+    [[maybe_unused]] Handle *removed =
+        table_.Remove(handle->key(), handle->hash);
+    assert(removed == handle);
+    FinishErase(handle);
+  }
+}
+template<typename T>
+void HandleCacheShard<T>::ListRemove(Handle *handle) {
+  handle->next->prev = handle->prev;
+  handle->prev->next = handle->next;
+}
+template<typename T>
+void HandleCacheShard<T>::ListAppend(LRULinks *list, Handle *handle) {
+  // the newest entry goes right before the head
+  handle->next = list;
+  handle->prev = list->prev;
+  handle->prev->next = handle;
+  list->prev = handle;
+}
+template<typename T>
+void HandleCacheShard<T>::Ref(Handle *handle) {
+  if (handle->refs == 1 && handle->in_cache) {
+    ListRemove(handle);
+    ListAppend(&in_use_, handle);
+  }
+  ++handle->refs;
+}
+template<typename T>
+void HandleCacheShard<T>::Unref(Handle *handle) {
+  assert(handle->refs > 0);
+  if (--handle->refs == 0) {
+    assert(!handle->in_cache);
+    Handle::Delete(handle);
+  } else if (handle->in_cache && handle->refs == 1) {
+    ListRemove(handle);
+    ListAppend(&lru_, handle);
+    // the usage may have grown past capacity while it was pinned
+    Evict();
+  }
+}
+template<typename T>
+void HandleCacheShard<T>::FinishErase(Handle *handle) {
+  assert(handle->in_cache);
+  ListRemove(handle);
+  handle->in_cache = false;
+  usage_ -= handle->charge;
+  Unref(handle);
+}
+template<typename T>
+void HandleCacheShard<T>::Evict() {
+  while (usage_ > capacity_ && lru_.next != &lru_) {
+    Handle *oldest = AsHandle(lru_.next);
+    assert(oldest->refs == 1);
+    [[maybe_unused]] Handle *removed =
+        table_.Remove(oldest->key(), oldest->hash);
+    assert(removed == oldest);
+    FinishErase(oldest);
+  }
+}
+
+}  // namespace impl
+
+// Cache of values by string key, built like the block cache of leveldb.
+// Each entry takes a single allocation holding its key bytes, value,
+// reference count, hash chain and LRU links. LRUCache stores the key once
+// too, but allocates its pair, the control block of the pair, a list node
+// and a table node, plus the key bytes once they outgrow the string.
+//
+// Insert and Lookup return a handle pinning the entry: its value stays
+// alive, even once evicted, erased or replaced, until the handle is passed
+// to Release. Every handle must be released before the cache is destroyed.
+// The cache is split into independently locked shards, picked like the
+// ones of ShardedCache, and the capacity bounds the total charge of the
+// entries not pinned by any handle.
+template<typename T>
+class HandleCache {
+ public:
+  // opaque to callers, read through Value and Key
+  using Handle = impl::LRUHandle<T>;
+
+  // 2^num_shard_bits shards, a count fit for the hardware concurrency if
+  // negative. Bits above kMaxShardBits are clamped to it
+  explicit HandleCache(size_t capacity, int num_shard_bits = -1);
+  HandleCache(const HandleCache &) = delete;
+  HandleCache &operator=(const HandleCache &) = delete;
+
+  // replaces any entry of the same key
+  [[nodiscard]] Handle *Insert(std::string_view key, T value,
+                               size_t charge = 1);
+  // null if key is not cached
+  [[nodiscard]] Handle *Lookup(std::string_view key);
+  void Release(Handle *handle);
+  T &Value(Handle *handle) const { return handle->value; }
+  std::string_view Key(const Handle *handle) const { return handle->key(); }
+  // entries still pinned stay alive until released
+  void Erase(std::string_view key);
+  // drops every entry not pinned by a handle
+  void Prune();
+  size_t TotalCharge();
+
+  [[nodiscard]] size_t num_shards() const { return shard_.size(); }
+
+  static constexpr int kMaxShardBits = impl::kMaxShardBits;
+
+ private:
+  struct alignas(impl::kCacheLineSize) AlignedShard :
+      impl::HandleCacheShard<T> {};
+
+  [[nodiscard]] impl::HandleCacheShard<T> &Shard(size_t hash) {
+    return *shard_[impl::ShardIndex(hash, num_shard_bits_)];
+  }
+
+  int num_shard_bits_;
+  // shards hold a mutex, so they stay put
+  std::vector<std::unique_ptr<AlignedShard>> shard_;
+};
+
+template<typename T>
+HandleCache<T>::HandleCache(size_t capacity, int num_shard_bits) :
+    num_shard_bits_(impl::ShardBits(num_shard_bits)) {
+  const size_t num_shards = size_t{1} << num_shard_bits_;
+  const size_t shard_capacity = (capacity + num_shards - 1) / num_shards;
+  for (size_t i = 0; i < num_shards; ++i) {
+    shard_.push_back(std::make_unique<AlignedShard>());
+    shard_.back()->set_capacity(shard_capacity);
+  }
+}
+template<typename T>
+typename HandleCache<T>::Handle *HandleCache<T>::Insert(
+    std::string_view key, T value, size_t charge) {
+  const size_t hash = yaldb::Hash(key);
+  return Shard(hash).Insert(key, hash, std::move(value), charge);
+}
+template<typename T>
+typename HandleCache<T>::Handle *HandleCache<T>::Lookup(std::string_view key) {
+  const size_t hash = yaldb::Hash(key);
+  return Shard(hash).Lookup(key, hash);
+}
+template<typename T>
+void HandleCache<T>::Release(Handle *handle) {
+  Shard(handle->hash).Release(handle);
+}
+template<typename T>
+void HandleCache<T>::Erase(std::string_view key) {
+  const size_t hash = yaldb::Hash(key);
+  Shard(hash).Erase(key, hash);
+}
+template<typename T>
+void HandleCache<T>::Prune() {
+  for (auto &shard : shard_) {
+    shard->Prune();
+  }
+}
+template<typename T>
+size_t HandleCache<T>::TotalCharge() {
+  size_t total = 0;
+  for (auto &shard : shard_) {
+    total += shard->TotalCharge();
+  }
+  return total;
+}
+
+}  // namespace yaldb
+
+#endif  // YALDB_HANDLE_CACHE_H_
@@ -0,0 +1,97 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef YALDB_HASH_H_
+#define YALDB_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace yaldb {
+
+namespace impl {
+
+// 64x64->128 bit multiply, folding the halves
+inline uint64_t Mum(uint64_t a, uint64_t b) {
+  const __uint128_t r = static_cast<__uint128_t>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+inline uint64_t Read64(const unsigned char *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+inline uint64_t Read32(const unsigned char *p) {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+// 1 to 3 bytes
+inline uint64_t Read3(const unsigned char *p, size_t len) {
+  return static_cast<uint64_t>(p[0]) << 16 |
+      static_cast<uint64_t>(p[len >> 1]) << 8 | p[len - 1];
+}
+
+}  // namespace impl
+
+// Hash of the wyhash family: 48 bytes a round over three independent
+// multiply-fold lanes, and a few loads for short keys, so every bit of the
+// result depends on every byte. Not for adversarial input.
+inline uint64_t Hash(std::string_view key, uint64_t seed = 0) {
+  constexpr uint64_t kSecret[] = {
+      0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+      0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull};
+  const auto *p = reinterpret_cast<const unsigned char *>(key.data());
+  const size_t len = key.size();
+  seed ^= impl::Mum(seed ^ kSecret[0], kSecret[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      const size_t mid = (len >> 3) << 2;
+      a = impl::Read32(p) << 32 | impl::Read32(p + mid);
+      b = impl::Read32(p + len - 4) << 32 | impl::Read32(p + len - 4 - mid);
+    } else if (len > 0) {
+      a = impl::Read3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t lane1 = seed, lane2 = seed;
+      do {
+        seed = impl::Mum(impl::Read64(p) ^ kSecret[1],
+                         impl::Read64(p + 8) ^ seed);
+        lane1 = impl::Mum(impl::Read64(p + 16) ^ kSecret[2],
+                          impl::Read64(p + 24) ^ lane1);
+        lane2 = impl::Mum(impl::Read64(p + 32) ^ kSecret[3],
+                          impl::Read64(p + 40) ^ lane2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= lane1 ^ lane2;
+    }
+    while (i > 16) {
+      seed = impl::Mum(impl::Read64(p) ^ kSecret[1],
+                       impl::Read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    // the last 16 bytes, overlapping the ones hashed already
+    a = impl::Read64(p + i - 16);
+    b = impl::Read64(p + i - 8);
+  }
+  a ^= kSecret[1];
+  b ^= seed;
+  const __uint128_t r = static_cast<__uint128_t>(a) * b;
+  a = static_cast<uint64_t>(r);
+  b = static_cast<uint64_t>(r >> 64);
+  return impl::Mum(a ^ kSecret[0] ^ len, b ^ kSecret[1]);
+}
+
+}  // namespace yaldb
+
+#endif  // YALDB_HASH_H_
@@ -0,0 +1,478 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#ifndef YALDB_INDEXED_SKIP_LIST_H_
+#define YALDB_INDEXED_SKIP_LIST_H_
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <random>
+#include <utility>
+
+#include "yaldb/arena.h"
+
+namespace yaldb {
+
+template<typename T, typename Comp, typename Alloc>
+class IndexedSkipList;
+
+namespace impl {
+
+// Every link also records its width: how many level 0 steps it jumps over.
+// The head has rank 0, elements have ranks 1..n and the tail has rank n + 1,
+// so the widths along any path from the head add up to the rank reached.
+template<typename T>
+struct IndexedSkipListNode {
+  struct Link {
+    IndexedSkipListNode *next;
+    size_t width;
+  };
+
+  // left unconstructed in the head and tail sentinels, like SkipListNode
+  union {
+    T value;
+  };
+  IndexedSkipListNode *back;
+  size_t level;
+  Link links[1];
+
+  IndexedSkipListNode(T value, const size_t level, IndexedSkipListNode *back) :
+      value(std::move(value)), back(back), level(level) {
+    for (size_t i = 0; i < level; ++i) {
+      links[i] = Link{nullptr, 0};
+    }
+  }
+  // a sentinel, holding no value
+  IndexedSkipListNode(const size_t level, IndexedSkipListNode *back) :
+      back(back), level(level) {
+    for (size_t i = 0; i < level; ++i) {
+      links[i] = Link{nullptr, 0};
+    }
+  }
+  // the owner destroys the value, sentinels have none
+  ~IndexedSkipListNode() {}
+  static constexpr size_t AllocationSize(const size_t level) {
+    return sizeof(IndexedSkipListNode) + sizeof(Link) * (level - 1);
+  }
+
+  // level 0 steps from node to the tail, following the tallest links
+  static size_t DistanceToEnd(const IndexedSkipListNode *node) {
+    size_t distance = 0;
+    while (node->links[0].next != nullptr) {
+      const Link &link = node->links[node->level - 1];
+      distance += link.width;
+      node = link.next;
+    }
+    return distance;
+  }
+  // node n steps further, in expected O(log n)
+  static IndexedSkipListNode *Skip(IndexedSkipListNode *node, size_t n) {
+    while (n > 0) {
+      assert(node->links[0].next != nullptr);
+      size_t i = node->level - 1;
+      while (node->links[i].width > n) {
+        --i;
+      }
+      n -= node->links[i].width;
+      node = node->links[i].next;
+    }
+    return node;
+  }
+};
+
+template<typename T>
+class IndexedSkipListIterator {
+ private:
+  using node_type = IndexedSkipListNode<T>;
+  template<typename U, typename Comp, typename Alloc> friend
+  class ::yaldb::IndexedSkipList;
+  // both null if default constructed, which is singular
+  node_type *node_ = nullptr;
+  node_type *head_ = nullptr;
+
+ public:
+  using difference_type = ptrdiff_t;
+
+  IndexedSkipListIterator() = default;
+  IndexedSkipListIterator(node_type *node, node_type *head) :
+      node_(node), head_(head) {}
+
+  const T &operator*() const { return node_->value; }
+  const T *operator->() const { return &node_->value; }
+  IndexedSkipListIterator &operator++() {
+    node_ = node_->links[0].next;
+    return *this;
+  }
+  IndexedSkipListIterator &operator--() {
+    node_ = node_->back;
+    return *this;
+  }
+  IndexedSkipListIterator operator++(int) {  // NOLINT
+    IndexedSkipListIterator it(*this);
+    ++(*this);
+    return it;
+  }
+  IndexedSkipListIterator operator--(int) {  // NOLINT
+    IndexedSkipListIterator it(*this);
+    --(*this);
+    return it;
+  }
+  // jumps along the towers in expected O(log n) instead of stepping
+  IndexedSkipListIterator &operator+=(difference_type n) {
+    if (n >= 0) {
+      node_ = node_type::Skip(node_, n);
+    } else {
+      const size_t rank = node_type::DistanceToEnd(head_)
+          - node_type::DistanceToEnd(node_);
+      node_ = node_type::Skip(head_, rank - static_cast<size_t>(-n));
+    }
+    return *this;
+  }
+  IndexedSkipListIterator &operator-=(difference_type n) {
+    return *this += -n;
+  }
+  IndexedSkipListIterator operator+(difference_type n) const {
+    IndexedSkipListIterator it(*this);
+    return it += n;
+  }
+  IndexedSkipListIterator operator-(difference_type n) const {
+    IndexedSkipListIterator it(*this);
+    return it -= n;
+  }
+  friend IndexedSkipListIterator operator+(
+      difference_type n, const IndexedSkipListIterator &it) {
+    return it + n;
+  }
+  difference_type operator-(const IndexedSkipListIterator &it) const {
+    return static_cast<difference_type>(node_type::DistanceToEnd(it.node_))
+        - static_cast<difference_type>(node_type::DistanceToEnd(node_));
+  }
+  const T &operator[](difference_type n) const { return *(*this + n); }
+  bool operator==(const IndexedSkipListIterator &it) const {
+    return node_ == it.node_;
+  }
+  bool operator!=(const IndexedSkipListIterator &it) const {
+    return node_ != it.node_;
+  }
+  // ordered by rank, in expected O(log n) like the distance
+  bool operator<(const IndexedSkipListIterator &it) const {
+    return *this - it < 0;
+  }
+  bool operator>(const IndexedSkipListIterator &it) const { return it < *this; }
+  bool operator<=(const IndexedSkipListIterator &it) const {
+    return !(it < *this);
+  }
+  bool operator>=(const IndexedSkipListIterator &it) const {
+    return !(*this < it);
+  }
+};
+
+}  // namespace impl
+
+// SkipList that additionally answers positional queries: At(k) selects the
+// k-th element, Rank(value) counts the elements ordered before value and
+// CountRange(lo, hi) counts the elements in [lo, hi), all in expected
+// O(log n). Its iterators are random access, moving and measuring distances
+// in expected O(log n) as well, which std::advance, std::distance and the
+// algorithms of <algorithm> pick up. The widths kept on every link make it
+// single-threaded: unlike SkipList it offers no concurrent writers and no
+// lock-free readers.
+template<typename T, typename Comp = std::less<T>,
+    typename Alloc = std::allocator<T>>
+class IndexedSkipList {
+ public:
+  using node_type = impl::IndexedSkipListNode<T>;
+  using iterator = impl::IndexedSkipListIterator<T>;
+  using const_iterator = iterator;
+  using allocator_type = Alloc;
+
+ private:
+  using ArenaType = Arena<
+      typename std::allocator_traits<Alloc>::template rebind_alloc<char>>;
+
+  [[nodiscard]] size_t RandomLevel() const;
+  node_type *NewNode(T value, size_t level, node_type *back);
+  node_type *NewSentinel(node_type *back);
+  static void DeleteNode(node_type *node);
+  // last node ordered before value and its rank
+  node_type *FindPrev(const T &value, size_t *rank) const;
+  // the same on every level; returns the rank at level 0
+  size_t FindPrev(const T &value, node_type **prev, size_t *rank) const;
+  [[nodiscard]] size_t CountNotGreater(const T &value) const;
+  // removes the elements with ranks in (first, last]
+  void EraseRanks(size_t first, size_t last);
+
+  static constexpr double kRandomRatio = 0.5;
+  static constexpr size_t kMaxLevel = 32;
+
+  Comp comp_;
+  ArenaType arena_;
+  mutable std::mt19937 rand_gen_;
+  size_t length_;
+  node_type *head_;
+  node_type *tail_;
+
+ public:
+  explicit IndexedSkipList(Comp comp = Comp(), const Alloc &alloc = Alloc());
+  IndexedSkipList(const IndexedSkipList &) = delete;
+  IndexedSkipList &operator=(const IndexedSkipList &) = delete;
+  ~IndexedSkipList();
+
+  size_t Size() const { return length_; }
+  bool Empty() const { return length_ == 0; }
+  // bytes held by the node arena
+  size_t MemoryUsage() const { return arena_.MemoryUsage(); }
+
+  iterator begin() const { return iterator(head_->links[0].next, head_); }
+  iterator end() const { return iterator(tail_, head_); }
+
+  iterator Insert(T value);
+  // like SkipList, erasing returns the iterator preceding the erased
+  // elements, or end() if nothing was erased
+  iterator Erase(const T &value);
+  iterator Erase(iterator it);
+  iterator Find(const T &value) const;
+  std::pair<iterator, iterator> EqualRange(const T &value) const;
+
+  // the element at zero-based position k, end() if k >= Size()
+  iterator At(size_t k) const;
+  // number of elements ordered before value
+  size_t Rank(const T &value) const;
+  // number of elements in [lo, hi)
+  size_t CountRange(const T &lo, const T &hi) const;
+};
+
+template<typename T, typename Comp, typename Alloc>
+size_t IndexedSkipList<T, Comp, Alloc>::RandomLevel() const {
+  size_t level = 1;
+  std::uniform_real_distribution<double> dis(0, 1);
+  while (dis(rand_gen_) < kRandomRatio && level < kMaxLevel) {
+    ++level;
+  }
+  return level;
+}
+template<typename T, typename Comp, typename Alloc>
+typename IndexedSkipList<T, Comp, Alloc>::node_type *
+IndexedSkipList<T, Comp, Alloc>::NewNode(
+    T value, size_t level, node_type *back) {
+  char *mem = arena_.AllocateAligned(
+      node_type::AllocationSize(level), alignof(node_type));
+  return new(mem) node_type(std::move(value), level, back);
+}
+template<typename T, typename Comp, typename Alloc>
+typename IndexedSkipList<T, Comp, Alloc>::node_type *
+IndexedSkipList<T, Comp, Alloc>::NewSentinel(node_type *back) {
+  char *mem = arena_.AllocateAligned(
+      node_type::AllocationSize(kMaxLevel), alignof(node_type));
+  return new(mem) node_type(kMaxLevel, back);
+}
+template<typename T, typename Comp, typename Alloc>
+void IndexedSkipList<T, Comp, Alloc>::DeleteNode(node_type *node) {
+  // the memory itself is owned by the arena
+  node->value.~T();
+  node->~node_type();
+}
+template<typename T, typename Comp, typename Alloc>
+size_t IndexedSkipList<T, Comp, Alloc>::FindPrev(
+    const T &value, node_type **prev, size_t *rank) const {
+  node_type *cur = head_;
+  size_t cur_rank = 0;
+  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
+    for (auto *link = &cur->links[i];
+         link->next != tail_ && comp_(link->next->value, value);
+         link = &cur->links[i]) {
+      cur_rank += link->width;
+      cur = link->next;
+    }
+    prev[i] = cur;
+    rank[i] = cur_rank;
+  }
+  return cur_rank;
+}
+template<typename T, typename Comp, typename Alloc>
+typename IndexedSkipList<T, Comp, Alloc>::node_type *
+IndexedSkipList<T, Comp, Alloc>::FindPrev(
+    const T &value, size_t *rank) const {
+  node_type *cur = head_;
+  size_t cur_rank = 0;
+  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
+    for (auto *link = &cur->links[i];
+         link->next != tail_ && comp_(link->next->value, value);
+         link = &cur->links[i]) {
+      cur_rank += link->width;
+      cur = link->next;
+    }
+  }
+  *rank = cur_rank;
+  return cur;
+}
+template<typename T, typename Comp, typename Alloc>
+size_t
+IndexedSkipList<T, Comp, Alloc>::CountNotGreater(const T &value) const {
+  size_t rank = 0;
+  node_type *cur = head_;
+  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
+    for (auto *link = &cur->links[i];
+         link->next != tail_ && !comp_(value, link->next->value);
+         link = &cur->links[i]) {
+      rank += link->width;
+      cur = link->next;
+    }
+  }
+  return rank;
+}
+template<typename T, typename Comp, typename Alloc>
+void IndexedSkipList<T, Comp, Alloc>::EraseRanks(size_t first, size_t last) {
+  const size_t count = last - first;
+  node_type *cur = head_, *doomed = nullptr;
+  size_t cur_rank = 0;
+  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
+    while (cur_rank + cur->links[i].width <= first) {
+      cur_rank += cur->links[i].width;
+      cur = cur->links[i].next;
+    }
+    // unlink every erased node on this level
+    node_type *next = cur->links[i].next;
+    size_t next_rank = cur_rank + cur->links[i].width;
+    if (i == 0) doomed = next;
+    while (next != tail_ && next_rank <= last) {
+      next_rank += next->links[i].width;
+      next = next->links[i].next;
+    }
+    cur->links[i].next = next;
+    cur->links[i].width = next_rank - count - cur_rank;
+  }
+  cur->links[0].next->back = cur;
+  for (size_t i = 0; i < count; ++i) {
+    node_type *tmp = doomed;
+    doomed = doomed->links[0].next;
+    DeleteNode(tmp);
+  }
+  length_ -= count;
+}
+
+template<typename T, typename Comp, typename Alloc>
+IndexedSkipList<T, Comp, Alloc>::IndexedSkipList(
+    Comp comp, const Alloc &alloc) :
+    comp_(std::move(comp)), arena_(alloc), length_(0) {
+  static_assert(std::is_invocable_v<Comp, const T &, const T &>);
+  static_assert(std::is_same_v<
+      bool, std::invoke_result_t<Comp, const T &, const T &>>);
+  std::random_device rd;
+  rand_gen_ = std::mt19937(rd());
+  head_ = NewSentinel(nullptr);
+  tail_ = NewSentinel(head_);
+  for (size_t i = 0; i < kMaxLevel; ++i) {
+    head_->links[i] = typename node_type::Link{tail_, 1};
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+IndexedSkipList<T, Comp, Alloc>::~IndexedSkipList() {
+  for (node_type *node = head_->links[0].next; node != tail_;) {
+    node_type *next = node->links[0].next;
+    DeleteNode(node);
+    node = next;
+  }
+  head_->~node_type();
+  tail_->~node_type();
+}
+template<typename T, typename Comp, typename Alloc>
+typename IndexedSkipList<T, Comp, Alloc>::iterator
+IndexedSkipList<T, Comp, Alloc>::Insert(T value) {
+  node_type *prev[kMaxLevel];
+  size_t rank[kMaxLevel];
+  const size_t node_rank = FindPrev(value, prev, rank) + 1;
+  const size_t level = RandomLevel();
+  node_type *node = NewNode(std::move(value), level, prev[0]);
+  for (size_t i = 0; i < level; ++i) {
+    auto &link = prev[i]->links[i];
+    node->links[i].next = link.next;
+    node->links[i].width = rank[i] + link.width + 1 - node_rank;
+    link.next = node;
+    link.width = node_rank - rank[i];
+  }
+  for (size_t i = level; i < kMaxLevel; ++i) {
+    ++prev[i]->links[i].width;
+  }
+  node->links[0].next->back = node;
+  ++length_;
+  return iterator(node, head_);
+}
+template<typename T, typename Comp, typename Alloc>
+typename IndexedSkipList<T, Comp, Alloc>::iterator
+IndexedSkipList<T, Comp, Alloc>::Erase(const T &value) {
+  const size_t first = Rank(value), last = CountNotGreater(value);
+  if (first == last) return end();
+  EraseRanks(first, last);
+  return iterator(node_type::Skip(head_, first), head_);
+}
+template<typename T, typename Comp, typename Alloc>
+typename IndexedSkipList<T, Comp, Alloc>::iterator
+IndexedSkipList<T, Comp, Alloc>::Erase(iterator it) {
+  if (it.node_ == tail_) return end();
+  const size_t rank = length_ + 1 - node_type::DistanceToEnd(it.node_);
+  EraseRanks(rank - 1, rank);
+  return iterator(node_type::Skip(head_, rank - 1), head_);
+}
+template<typename T, typename Comp, typename Alloc>
+typename IndexedSkipList<T, Comp, Alloc>::iterator
+IndexedSkipList<T, Comp, Alloc>::Find(const T &value) const {
+  size_t rank;
+  node_type *next = FindPrev(value, &rank)->links[0].next;
+  if (next != tail_ && !comp_(value, next->value)) {
+    return iterator(next, head_);
+  } else {
+    return end();
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+std::pair<typename IndexedSkipList<T, Comp, Alloc>::iterator,
+          typename IndexedSkipList<T, Comp, Alloc>::iterator>
+IndexedSkipList<T, Comp, Alloc>::EqualRange(const T &value) const {
+  size_t rank;
+  iterator first(FindPrev(value, &rank)->links[0].next, head_), last = first;
+  while (last.node_ != tail_ && !comp_(value, last.node_->value)) {
+    ++last;
+  }
+  return std::make_pair(first, last);
+}
+template<typename T, typename Comp, typename Alloc>
+typename IndexedSkipList<T, Comp, Alloc>::iterator
+IndexedSkipList<T, Comp, Alloc>::At(size_t k) const {
+  if (k >= length_) return end();
+  return iterator(node_type::Skip(head_, k + 1), head_);
+}
+template<typename T, typename Comp, typename Alloc>
+size_t IndexedSkipList<T, Comp, Alloc>::Rank(const T &value) const {
+  size_t rank;
+  FindPrev(value, &rank);
+  return rank;
+}
+template<typename T, typename Comp, typename Alloc>
+size_t IndexedSkipList<T, Comp, Alloc>::CountRange(
+    const T &lo, const T &hi) const {
+  if (!comp_(lo, hi)) return 0;
+  return Rank(hi) - Rank(lo);
+}
+
+}  // namespace yaldb
+
+namespace std {
+
+template<typename T>
+struct iterator_traits<yaldb::impl::IndexedSkipListIterator<T>> {
+  typedef random_access_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef ptrdiff_t difference_type;
+  typedef const T *pointer;
+  typedef const T &reference;
+};
+
+}  // namespace std
+
+#endif  // YALDB_INDEXED_SKIP_LIST_H_
@@ -0,0 +1,154 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#ifndef YALDB_MERGING_ITERATOR_H_
+#define YALDB_MERGING_ITERATOR_H_
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "yaldb/skip_list.h"
+
+namespace yaldb {
+
+// Forward cursor yielding the elements of several SkipLists as one sorted
+// sequence, the way a LSM tree reads its memtable together with the
+// immutable ones. The lists are given from newest to oldest and equal
+// elements come out newest first. With dedup, only the first element of
+// each run of equal ones is yielded, so the newest list wins.
+//
+// The children are kept in a binary heap ordered by their current element:
+// a step costs O(log N) comparisons for N lists, and elements are referred
+// to in place, never copied. The lists must outlive the iterator, share its
+// comparator and follow the threading rules of their ScanIterators.
+template<typename T, typename Comp = std::less<T>,
+    typename Alloc = std::allocator<T>>
+class MergingIterator {
+ public:
+  using list_type = SkipList<T, Comp, Alloc>;
+
+  explicit MergingIterator(const std::vector<const list_type *> &lists,
+                           bool dedup = false);
+
+  bool Valid() const { return !heap_.empty(); }
+  const T &value() const {
+    assert(Valid());
+    return children_[heap_.front()].value();
+  }
+  // index of the list the current element belongs to, 0 being the newest
+  size_t source() const {
+    assert(Valid());
+    return heap_.front();
+  }
+  void Next();
+  // positions at the first element not less than target
+  void Seek(const T &target);
+  void SeekToFirst();
+
+ private:
+  using Child = typename list_type::ScanIterator;
+
+  // whether child a goes before child b, ties go to the newer list
+  bool Before(size_t a, size_t b) const;
+  void BuildHeap();
+  void SiftDown(size_t pos);
+  // steps the child on top of the heap and restores the heap
+  void NextTop();
+
+  Comp comp_;
+  bool dedup_;
+  std::vector<Child> children_;
+  // indices of the valid children, the first one holding the least element
+  std::vector<size_t> heap_;
+};
+
+template<typename T, typename Comp, typename Alloc>
+MergingIterator<T, Comp, Alloc>::MergingIterator(
+    const std::vector<const list_type *> &lists, bool dedup) :
+    comp_(lists.empty() ? Comp() : lists.front()->Comparator()),
+    dedup_(dedup) {
+  children_.reserve(lists.size());
+  heap_.reserve(lists.size());
+  for (const list_type *list : lists) {
+    children_.emplace_back(list);
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+void MergingIterator<T, Comp, Alloc>::Next() {
+  assert(Valid());
+  if (!dedup_) {
+    NextTop();
+    return;
+  }
+  // the element lives in a list node, so the reference outlives the step
+  const T &last = value();
+  do {
+    NextTop();
+  } while (Valid() && !comp_(last, value()));
+}
+template<typename T, typename Comp, typename Alloc>
+void MergingIterator<T, Comp, Alloc>::Seek(const T &target) {
+  for (Child &child : children_) {
+    child.Seek(target);
+  }
+  BuildHeap();
+}
+template<typename T, typename Comp, typename Alloc>
+void MergingIterator<T, Comp, Alloc>::SeekToFirst() {
+  for (Child &child : children_) {
+    child.SeekToFirst();
+  }
+  BuildHeap();
+}
+template<typename T, typename Comp, typename Alloc>
+bool MergingIterator<T, Comp, Alloc>::Before(size_t a, size_t b) const {
+  const T &lhs = children_[a].value(), &rhs = children_[b].value();
+  if (comp_(lhs, rhs)) return true;
+  return !comp_(rhs, lhs) && a < b;
+}
+template<typename T, typename Comp, typename Alloc>
+void MergingIterator<T, Comp, Alloc>::BuildHeap() {
+  heap_.clear();
+  for (size_t i = 0; i < children_.size(); ++i) {
+    if (children_[i].Valid()) {
+      heap_.push_back(i);
+    }
+  }
+  for (size_t pos = heap_.size() / 2; pos > 0; --pos) {
+    SiftDown(pos - 1);
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+void MergingIterator<T, Comp, Alloc>::SiftDown(size_t pos) {
+  const size_t size = heap_.size(), child = heap_[pos];
+  for (size_t left = pos * 2 + 1; left < size; left = pos * 2 + 1) {
+    size_t least = left;
+    if (left + 1 < size && Before(heap_[left + 1], heap_[left])) {
+      least = left + 1;
+    }
+    if (!Before(heap_[least], child)) break;
+    heap_[pos] = heap_[least];
+    pos = least;
+  }
+  heap_[pos] = child;
+}
+template<typename T, typename Comp, typename Alloc>
+void MergingIterator<T, Comp, Alloc>::NextTop() {
+  Child &top = children_[heap_.front()];
+  top.Next();
+  if (!top.Valid()) {
+    heap_.front() = heap_.back();
+    heap_.pop_back();
+    if (heap_.empty()) return;
+  }
+  SiftDown(0);
+}
+
+}  // namespace yaldb
+
+#endif  // YALDB_MERGING_ITERATOR_H_
@@ -0,0 +1,47 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef YALDB_SHARD_H_
+#define YALDB_SHARD_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>  // NOLINT
+
+namespace yaldb {
+
+namespace impl {
+
+// what shards are aligned to, so that they never share a line
+inline constexpr size_t kCacheLineSize = 64;
+
+inline constexpr int kMaxShardBits = 6;
+
+// twice as many shards as hardware threads, at most 2^kMaxShardBits
+inline int DefaultShardBits() {
+  const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  int bits = 0;
+  while (bits < kMaxShardBits && (size_t{1} << bits) < threads * 2) {
+    ++bits;
+  }
+  return bits;
+}
+
+// num_shard_bits clamped to kMaxShardBits, DefaultShardBits if negative
+inline int ShardBits(int num_shard_bits) {
+  return num_shard_bits < 0 ?
+      DefaultShardBits() : std::min(num_shard_bits, kMaxShardBits);
+}
+
+// the tables of shards index with the low bits of hash, so pick the shard
+// by the high ones
+inline size_t ShardIndex(uint64_t hash, int num_shard_bits) {
+  return num_shard_bits == 0 ? 0 : hash >> (64 - num_shard_bits);
+}
+
+}  // namespace impl
+
+}  // namespace yaldb
+
+#endif  // YALDB_SHARD_H_
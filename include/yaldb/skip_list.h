@@ -5,70 +5,127 @@
 #ifndef YALDB_SKIP_LIST_H_
 #define YALDB_SKIP_LIST_H_
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <ctime>
 #include <functional>
+#include <iterator>
 #include <random>
 #include <memory>
+#include <new>
 #include <utility>
+#include <vector>
+
+#include "yaldb/arena.h"
 
 namespace yaldb {
 
-template<typename T, typename Comp>
+template<typename T, typename Comp, typename Alloc>
 class SkipList;
 
 namespace impl {
 
+// A node and its tower of links live in one block: `links` is declared with a
+// single element but the allocation reserves room for `level` of them.
+// Links are published with release stores and read with acquire loads, so a
+// reader that reaches a node through any link observes it fully initialized.
+//
+// The lowest bit of a link marks the node owning the link as erased at that
+// level by a concurrent writer. Next / NoBarrierNext strip the mark, RawNext
+// keeps it for the lock-free algorithms. A node is erased once its level 0
+// link is marked.
 template<typename T>
 struct SkipListNode {
-  T value;
-  SkipListNode *back;
+  // left unconstructed in the head and tail sentinels
+  union {
+    T value;
+  };
+  std::atomic<SkipListNode *> back;
   size_t level;
-//  struct NodeLink {
-//    SkipListNode *n;
-//    NodeLink() : n(nullptr) {}
-//  } links[1];
-  SkipListNode **links;
-/*
-//  static void *operator new(const std::size_t size) {
-//    return ::operator new(size);
-//  }
-//  static void operator delete(void *ptr) {
-//
-//  }
-//  static void *operator new(const std::size_t size, const int level) {
-//    assert(level > 0);
-//    return ::operator new(size + (level - 1) * sizeof(NodeLink));
-//  }
-//  static void operator delete(void *ptr, const int level) {
-//    return ::operator delete(ptr, sizeof(SkipListNode)
-//        + (level - 1) * sizeof(NodeLink));
-//  }
-//  static void
-//  operator delete(void *ptr, const std::size_t size, const int level) {
-//    return ::operator delete(ptr, size);
-//  }
- */
+  std::atomic<SkipListNode *> links[1];
+
   SkipListNode(T value, const size_t level, SkipListNode *back) :
       value(std::move(value)), back(back), level(level) {
-    links = new SkipListNode *[level];
-//    std::uninitialized_fill_n(
-//        &links[0], level * sizeof(SkipListNode *), nullptr);
     for (size_t i = 0; i < level; ++i) {
-      links[i] = nullptr;
+      links[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+  // a sentinel, holding no value
+  SkipListNode(const size_t level, SkipListNode *back) :
+      back(back), level(level) {
+    for (size_t i = 0; i < level; ++i) {
+      links[i].store(nullptr, std::memory_order_relaxed);
     }
-//    printf("construct level: %lu\n", level);
   }
-  ~SkipListNode() {
-//    printf("destruct level: %lu\n", level);
-    delete[](links);
+  // the owner destroys the value, sentinels have none
+  ~SkipListNode() {}
+  static constexpr size_t AllocationSize(const size_t level) {
+    return sizeof(SkipListNode)
+        + sizeof(std::atomic<SkipListNode *>) * (level - 1);
+  }
+
+  static bool IsMarked(SkipListNode *node) {
+    return (reinterpret_cast<uintptr_t>(node) & 1u) != 0;
+  }
+  static SkipListNode *Mark(SkipListNode *node) {
+    return reinterpret_cast<SkipListNode *>(
+        reinterpret_cast<uintptr_t>(node) | 1u);
+  }
+  static SkipListNode *Unmark(SkipListNode *node) {
+    return reinterpret_cast<SkipListNode *>(
+        reinterpret_cast<uintptr_t>(node) & ~uintptr_t(1));
+  }
+
+  SkipListNode *Next(size_t n) const {
+    return Unmark(links[n].load(std::memory_order_acquire));
+  }
+  void SetNext(size_t n, SkipListNode *node) {
+    links[n].store(node, std::memory_order_release);
+  }
+  // only safe where the writer is the sole observer, e.g. before publishing
+  SkipListNode *NoBarrierNext(size_t n) const {
+    return Unmark(links[n].load(std::memory_order_relaxed));
+  }
+  void NoBarrierSetNext(size_t n, SkipListNode *node) {
+    links[n].store(node, std::memory_order_relaxed);
+  }
+  SkipListNode *Back() const {
+    return back.load(std::memory_order_acquire);
+  }
+  void SetBack(SkipListNode *node) {
+    back.store(node, std::memory_order_release);
+  }
+
+  // the concurrent writers order their link updates sequentially, so that
+  // an eraser and an inserter always observe each other's marks and links
+  SkipListNode *RawNext(size_t n) const { return links[n].load(); }
+  bool CasNext(size_t n, SkipListNode *&expected, SkipListNode *node) {
+    return links[n].compare_exchange_strong(expected, node);
+  }
+  bool IsDeleted() const { return IsMarked(RawNext(0)); }
+  // nearest successor that has not been erased
+  SkipListNode *NextLive() const {
+    SkipListNode *node = Next(0);
+    while (node != nullptr && node->IsDeleted()) {
+      node = node->Next(0);
+    }
+    return node;
+  }
+  SkipListNode *BackLive() const {
+    SkipListNode *node = Back();
+    while (node->IsDeleted()) {
+      node = node->Back();
+    }
+    return node;
   }
 };
 
 template<typename T>
 class SkipListIterator {
  private:
-  template<typename U, typename Comp> friend
+  template<typename U, typename Comp, typename Alloc> friend
   class ::yaldb::SkipList;
   friend class SkipListNode<std::remove_const_t<T>>;
   SkipListNode<T> *node_;
@@ -81,7 +138,9 @@ class SkipListIterator {
 //      std::is_same_v<T, U> || std::is_same_v<std::remove_const_t<T>, U>,
 //      int> = 0>
 //  SkipListIterator(const SkipListIterator<U> &it) : node_(it.node_) {} // NOLINT
+  SkipListIterator() : node_(nullptr) {}
   SkipListIterator(const SkipListIterator &it) : node_(it.node_) {}
+  SkipListIterator &operator=(const SkipListIterator &it) = default;
   explicit SkipListIterator(SkipListNode<T> *node) : node_(node) {}
 
 //  T &operator*() { return node_->value; }
@@ -89,11 +148,11 @@ class SkipListIterator {
 //  T *operator->() { return &node_->value; }
   const T *operator->() const { return &node_->value; }
   SkipListIterator &operator++() {
-    node_ = node_->links[0];
+    node_ = node_->NextLive();
     return *this;
   }
   SkipListIterator &operator--() {
-    node_ = node_->back;
+    node_ = node_->BackLive();
     return *this;
   }
   SkipListIterator operator++(int) {  // NOLINT
@@ -120,216 +179,1013 @@ class SkipListIterator {
 
 }  // namespace impl
 
+// Nodes are carved from an arena owned by the list, so the value and its
+// tower share one allocation and every node is released in bulk by the
+// destructor. Erasing an element destroys its value, but the node's bytes
+// stay reserved in the arena until the list itself is destroyed. Split and
+// Join hand nodes over to another list by relinking them, so the lists
+// involved share ownership of the arenas those nodes live in.
+//
+// Thread safety works like a LSM memtable: a single writer may Insert while
+// any number of readers concurrently call Find, EqualRange, Size, Empty,
+// MemoryUsage or iterate, all without locking. Writers must be serialized
+// externally, and Erase / destruction require that no reader is active.
+//
+// InsertConcurrently and EraseConcurrently lift the single writer
+// restriction: any number of threads may call them together with the
+// readers above. They splice each level with compare-and-swap and retry
+// locally on contention. Concurrently erased elements are unlinked at once,
+// but their values are only destroyed together with the list, since readers
+// may still be standing on them. Insert and Erase must not overlap with the
+// concurrent writers.
 // template<typename T, bool(*Less)(T, T)>
-template<typename T, typename Comp = std::less<T>>
+template<typename T, typename Comp = std::less<T>,
+    typename Alloc = std::allocator<T>>
 class SkipList {
  public:
   using node_type = impl::SkipListNode<T>;
   using iterator = impl::SkipListIterator<T>;
   using const_iterator = iterator;
+  using allocator_type = Alloc;
 
  private:
-  [[nodiscard]] size_t RandomLevel() const;
-  [[nodiscard]] node_type *FindPrev(const T &value) const;
-  node_type *FindPrev(const T &value, node_type **prev) const;
+  using ArenaType = ConcurrentArena<
+      typename std::allocator_traits<Alloc>::template rebind_alloc<char>>;
+  // singly linked stack of concurrently erased nodes, kept in the arena
+  struct RetiredNode {
+    node_type *node;
+    RetiredNode *next;
+  };
+
+  static size_t RandomLevel(std::mt19937 &rand_gen);
+  node_type *NewNode(T value, size_t level, node_type *back);
+  node_type *NewNodeConcurrently(T value, size_t level, node_type *back);
+  node_type *NewSentinel(node_type *back);
+  static void DeleteNode(node_type *node);
+  // the searches below take a T or, with a transparent comparator, any key
+  // comparable with it
+  template<typename K>
+  [[nodiscard]] node_type *FindPrev(const K &key) const;
+  template<typename K>
+  node_type *FindPrev(const K &key, node_type **prev) const;
+  // last node not greater than key, or the head
+  template<typename K>
+  [[nodiscard]] node_type *FindLastNotGreater(const K &key) const;
+  // first live node after prev not less than key; the writer may have
+  // linked smaller elements after prev since a search stopped there
+  template<typename K>
+  node_type *NextNotLess(node_type *prev, const K &key) const;
+  // first live node after prev greater than key, likewise
+  template<typename K>
+  node_type *NextGreater(node_type *prev, const K &key) const;
+  template<typename K>
+  iterator FindKey(const K &key) const;
+  template<typename K>
+  iterator EraseKey(const K &key);
+  // finger search: refreshes a splice left by an earlier search, starting
+  // from the lowest level whose saved nodes still bracket value
+  void FindPrevFromSplice(const T &value, node_type **prev) const;
+  // finger search from a single node; returns how many levels of prev were
+  // filled, which are all levels if the hint was of no use
+  size_t FindPrevFromHint(
+      node_type *hint, const T &value, node_type **prev) const;
+  node_type *InsertAfter(node_type **prev, T value, size_t level);
+  size_t MaxLevel() const {
+    return max_level_.load(std::memory_order_relaxed);
+  }
+  void RaiseMaxLevel(size_t level);
+  void FindConcurrently(const T &value, node_type **preds, node_type **succs);
+  bool UnlinkMarked(size_t level, const T &value, node_type *pred);
+  void Unlink(node_type *node);
+  void FixBack(node_type *node);
+  void Retire(node_type *node);
+  // last node of every level, or the head where a level is empty
+  void FindLast(node_type **last) const;
+  // lowers the height to the tallest tower left, e.g. after a split
+  void ShrinkMaxLevel();
+  void ShareArenas(const SkipList &other);
 
   static constexpr double kRandomRatio = 0.5;
   static constexpr size_t kMaxLevel = 32;
+  // how far a hinted search walks back before restarting from the head
+  static constexpr size_t kMaxHintBackSteps = 8;
+  static constexpr size_t kDefaultPrefetchDistance = 4;
+  // searches MultiFind keeps in flight, enough to cover the misses a core
+  // can have outstanding
+  static constexpr size_t kMultiFindGroupSize = 16;
 
   Comp comp_;
+  std::shared_ptr<ArenaType> arena_;
+  // arenas of other lists still holding nodes handed over by Split or Join
+  std::vector<std::shared_ptr<ArenaType>> shared_arenas_;
   mutable std::mt19937 rand_gen_;
-  size_t length_;
+  std::atomic<size_t> length_;
+  // height of the tallest tower, searches start there instead of at the top
+  std::atomic<size_t> max_level_;
   node_type *head_;
   node_type *tail_;
+  std::atomic<RetiredNode *> retired_;
 
  public:
-  explicit SkipList(Comp comp = std::less<T>());  // NOLINT
+  // Cursor for range scans, valid while the list is alive and following the
+  // same threading rules as iterator. Moving forward keeps a second pointer
+  // prefetch_distance nodes ahead and prefetches the node it reaches, so the
+  // cache misses of chasing level 0 overlap with the work done per element.
+  // A distance of 0 disables prefetching.
+  class ScanIterator {
+   public:
+    explicit ScanIterator(const SkipList *list,
+                          size_t prefetch_distance = kDefaultPrefetchDistance) :
+        list_(list), prefetch_distance_(prefetch_distance),
+        node_(nullptr), ahead_(nullptr) {}
+
+    bool Valid() const { return node_ != nullptr; }
+    const T &value() const {
+      assert(Valid());
+      return node_->value;
+    }
+    void Next();
+    void Prev();
+    // positions at the first element not less than target
+    void Seek(const T &target);
+    // positions at the last element not greater than target
+    void SeekForPrev(const T &target);
+    void SeekToFirst();
+    void SeekToLast();
+
+   private:
+    void SetNode(node_type *node);
+    void ResetAhead();
+
+    const SkipList *list_;
+    size_t prefetch_distance_;
+    node_type *node_;
+    // prefetch cursor, lazily placed when scanning forward
+    node_type *ahead_;
+  };
+
+  explicit SkipList(Comp comp = Comp(),  // NOLINT
+                    const Alloc &alloc = Alloc());
+  // builds a perfectly balanced list from a sorted range in one pass.
+  // Elements equal to each other keep their order in the range
+  template<typename InputIt, typename = typename
+      std::iterator_traits<InputIt>::iterator_category>
+  SkipList(InputIt first, InputIt last, Comp comp = Comp(),
+           const Alloc &alloc = Alloc());
+  SkipList(const SkipList &) = delete;
+  SkipList &operator=(const SkipList &) = delete;
   ~SkipList();
 
-  size_t Size() const { return length_; }
-  bool Empty() const { return length_ == 0; }
+  size_t Size() const { return length_.load(std::memory_order_relaxed); }
+  bool Empty() const { return Size() == 0; }
+  // bytes held by the node arenas, which lists sharing arenas after Split
+  // or Join all count in full
+  size_t MemoryUsage() const;
+  const Comp &Comparator() const { return comp_; }
 
-  iterator begin() { return iterator(head_->links[0]); }
+  iterator begin() { return iterator(head_->NextLive()); }
   iterator end() { return iterator(tail_); }
   [[nodiscard]] const_iterator begin() const {
-    return const_iterator(head_->links[0]);
+    return const_iterator(head_->NextLive());
   }
   [[nodiscard]] const_iterator end() const {
     return const_iterator(tail_);
   }
 
+  // links value in front of the elements equal to it, as all insertions do
   iterator Insert(T value);
-  iterator Erase(const T &value);
+  // searches outward from hint, cheap when value belongs close to it
+  iterator Insert(iterator hint, T value);
+  // inserts a range, fastest when it is sorted: each search continues from
+  // where the previous element was linked instead of from the head
+  template<typename InputIt>
+  void InsertBatch(InputIt first, InputIt last);
+  // erases every element equal to value
+  iterator Erase(const T &value) { return EraseKey(value); }
   iterator Erase(iterator it);
-  iterator Find(const T &value) const;
+  iterator Find(const T &value) const { return FindKey(value); }
+  iterator Find(iterator hint, const T &value) const;
+  // stores Find(values[i]) into result[i] for every i < n. The searches run
+  // interleaved, each prefetching the node it compares next while the others
+  // step, so the cache misses of a batch overlap instead of adding up.
+  void MultiFind(const T *values, size_t n, iterator *result) const;
+  // first element not less than value
+  iterator LowerBound(const T &value) const;
+  // first element greater than value
+  iterator UpperBound(const T &value) const;
   std::pair<iterator, iterator> EqualRange(const T &value) const;
+
+  // With a transparent comparator such as std::less<>, these lookups take
+  // any key comparable with T, so probing needs no T to be built.
+  template<typename K, typename C = Comp,
+      typename = typename C::is_transparent>
+  iterator Find(const K &key) const { return FindKey(key); }
+  template<typename K, typename C = Comp,
+      typename = typename C::is_transparent>
+  iterator Erase(const K &key) { return EraseKey(key); }
+  template<typename K, typename C = Comp,
+      typename = typename C::is_transparent>
+  iterator LowerBound(const K &key) const {
+    return iterator(NextNotLess(FindPrev(key), key));
+  }
+  template<typename K, typename C = Comp,
+      typename = typename C::is_transparent>
+  iterator UpperBound(const K &key) const {
+    return iterator(NextGreater(FindLastNotGreater(key), key));
+  }
+  template<typename K, typename C = Comp,
+      typename = typename C::is_transparent>
+  std::pair<iterator, iterator> EqualRange(const K &key) const {
+    return std::make_pair(LowerBound(key), UpperBound(key));
+  }
+
+  iterator InsertConcurrently(T value);
+  // erases one element equal to value, returns whether there was one
+  bool EraseConcurrently(const T &value);
+
+  // Moves the elements not less than value into a new list, and Join
+  // appends the elements of other, which must not be less than any element
+  // of this list, leaving other empty. After O(log n) searches both relink
+  // a couple of links per level, without moving or copying any node; Split
+  // also walks the smaller side to count the elements moved. Neither may
+  // overlap with any other access to the lists involved.
+  std::unique_ptr<SkipList> Split(const T &value);
+  void Join(SkipList *other);
 };
 
-template<typename T, typename Comp>
-size_t SkipList<T, Comp>::RandomLevel() const {
+template<typename T, typename Comp, typename Alloc>
+size_t SkipList<T, Comp, Alloc>::RandomLevel(std::mt19937 &rand_gen) {
   size_t level = 1;
   std::uniform_real_distribution<double> dis(0, 1);
-  while (dis(rand_gen_) < kRandomRatio && level < kMaxLevel) {
+  while (dis(rand_gen) < kRandomRatio && level < kMaxLevel) {
     ++level;
   }
   return level;
 }
-template<typename T, typename Comp>
-typename SkipList<T, Comp>::node_type *
-SkipList<T, Comp>::FindPrev(const T &value) const {
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::NewNode(T value, size_t level, node_type *back) {
+  char *mem = arena_->AllocateAligned(
+      node_type::AllocationSize(level), alignof(node_type));
+  return new(mem) node_type(std::move(value), level, back);
+}
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::NewNodeConcurrently(
+    T value, size_t level, node_type *back) {
+  char *mem = arena_->AllocateAlignedConcurrently(
+      node_type::AllocationSize(level), alignof(node_type));
+  return new(mem) node_type(std::move(value), level, back);
+}
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::NewSentinel(node_type *back) {
+  char *mem = arena_->AllocateAligned(
+      node_type::AllocationSize(kMaxLevel), alignof(node_type));
+  return new(mem) node_type(kMaxLevel, back);
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::DeleteNode(node_type *node) {
+  // the memory itself is owned by the arena
+  node->value.~T();
+  node->~node_type();
+}
+template<typename T, typename Comp, typename Alloc>
+template<typename K>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::FindPrev(const K &key) const {
   node_type *cur = head_;
-  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
-    while (cur->links[i] != tail_ && comp_(cur->links[i]->value, value)) {
-      cur = cur->links[i];
+  for (size_t i = MaxLevel() - 1; i != size_t() - 1; --i) {
+    for (node_type *next = cur->Next(i);
+         next != tail_ && comp_(next->value, key); next = cur->Next(i)) {
+      cur = next;
     }
   }
   return cur;
 }
-template<typename T, typename Comp>
-typename SkipList<T, Comp>::node_type *
-SkipList<T, Comp>::FindPrev(const T &value, node_type **prev) const {
+template<typename T, typename Comp, typename Alloc>
+template<typename K>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::FindPrev(const K &key, node_type **prev) const {
   node_type *cur = head_;
-  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
-    while (cur->links[i] != tail_ && comp_(cur->links[i]->value, value)) {
-      cur = cur->links[i];
+  for (size_t i = MaxLevel() - 1; i != size_t() - 1; --i) {
+    for (node_type *next = cur->Next(i);
+         next != tail_ && comp_(next->value, key); next = cur->Next(i)) {
+      cur = next;
     }
     prev[i] = cur;
   }
   return cur;
 }
+template<typename T, typename Comp, typename Alloc>
+template<typename K>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::FindLastNotGreater(const K &key) const {
+  node_type *cur = head_;
+  for (size_t i = MaxLevel() - 1; i != size_t() - 1; --i) {
+    for (node_type *next = cur->Next(i);
+         next != tail_ && !comp_(key, next->value); next = cur->Next(i)) {
+      cur = next;
+    }
+  }
+  return cur;
+}
+template<typename T, typename Comp, typename Alloc>
+template<typename K>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::NextNotLess(node_type *prev, const K &key) const {
+  node_type *node = prev->NextLive();
+  while (node != tail_ && comp_(node->value, key)) {
+    node = node->NextLive();
+  }
+  return node;
+}
+template<typename T, typename Comp, typename Alloc>
+template<typename K>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::NextGreater(node_type *prev, const K &key) const {
+  node_type *node = prev->NextLive();
+  while (node != tail_ && !comp_(key, node->value)) {
+    node = node->NextLive();
+  }
+  return node;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::FindPrevFromSplice(
+    const T &value, node_type **prev) const {
+  const size_t top = MaxLevel() - 1;
+  size_t level = 0;
+  for (; level < top; ++level) {
+    node_type *next = prev[level]->Next(level);
+    // strictly before value, so that value goes in front of the elements
+    // equal to it, as FindPrev places it
+    if ((prev[level] == head_ || comp_(prev[level]->value, value)) &&
+        (next == tail_ || !comp_(next->value, value))) {
+      // levels above a bracketing one bracket value as well
+      break;
+    }
+  }
+  node_type *cur = prev[level];
+  if (cur != head_ && !comp_(cur->value, value)) {
+    cur = head_;
+  }
+  for (size_t i = level; i != size_t() - 1; --i) {
+    for (node_type *next = cur->Next(i);
+         next != tail_ && comp_(next->value, value); next = cur->Next(i)) {
+      cur = next;
+    }
+    prev[i] = cur;
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+size_t SkipList<T, Comp, Alloc>::FindPrevFromHint(
+    node_type *hint, const T &value, node_type **prev) const {
+  // step back over a few nodes if value belongs before the hint
+  node_type *cur = hint;
+  for (size_t steps = 0;
+       cur != head_ && (cur == tail_ || !comp_(cur->value, value));
+       ++steps) {
+    if (steps == kMaxHintBackSteps) {
+      FindPrev(value, prev);
+      return MaxLevel();
+    }
+    cur = cur->BackLive();
+  }
+  if (cur == head_) {
+    FindPrev(value, prev);
+    return MaxLevel();
+  }
+  // climb while the tallest link of the current node still ends before
+  // value, then descend as usual
+  size_t level = cur->level - 1;
+  for (node_type *next = cur->Next(level);
+       next != tail_ && comp_(next->value, value); next = cur->Next(level)) {
+    cur = next;
+    level = cur->level - 1;
+  }
+  for (size_t i = level; i != size_t() - 1; --i) {
+    for (node_type *next = cur->Next(i);
+         next != tail_ && comp_(next->value, value); next = cur->Next(i)) {
+      cur = next;
+    }
+    prev[i] = cur;
+  }
+  return level + 1;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::RaiseMaxLevel(size_t level) {
+  // readers may observe the new height before any link on it: they then
+  // find the head pointing to the tail and simply descend
+  size_t max_level = MaxLevel();
+  while (level > max_level &&
+      !max_level_.compare_exchange_weak(
+          max_level, level, std::memory_order_relaxed)) {}
+}
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::node_type *
+SkipList<T, Comp, Alloc>::InsertAfter(node_type **prev, T value,
+                                      size_t level) {
+  if (const size_t max_level = MaxLevel(); level > max_level) {
+    std::fill(prev + max_level, prev + level, head_);
+    RaiseMaxLevel(level);
+  }
+  node_type *node = NewNode(std::move(value), level, prev[0]);
+  // the node is invisible until linked, so its own links need no barrier
+  for (size_t i = 0; i < level; ++i) {
+    node->NoBarrierSetNext(i, prev[i]->NoBarrierNext(i));
+  }
+  // publish bottom-up: a reader that finds the node at some level can
+  // always continue its descent through the levels below
+  for (size_t i = 0; i < level; ++i) {
+    prev[i]->SetNext(i, node);
+  }
+  node->NoBarrierNext(0)->SetBack(node);
+  length_.fetch_add(1, std::memory_order_relaxed);
+  return node;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::FindConcurrently(
+    const T &value, node_type **preds, node_type **succs) {
+  bool retry = true;
+  while (retry) {
+    retry = false;
+    node_type *pred = head_;
+    for (size_t i = MaxLevel() - 1; i != size_t() - 1 && !retry; --i) {
+      node_type *cur = node_type::Unmark(pred->RawNext(i));
+      while (cur != tail_) {
+        node_type *next = cur->RawNext(i);
+        if (node_type::IsMarked(next)) {
+          // cur is being erased, help to unlink it before stepping over
+          node_type *expected = cur;
+          next = node_type::Unmark(next);
+          if (!pred->CasNext(i, expected, next)) {
+            // pred changed or is being erased itself
+            retry = true;
+            break;
+          }
+          if (i == 0) FixBack(next);
+          cur = next;
+        } else if (comp_(cur->value, value)) {
+          pred = cur;
+          cur = next;
+        } else {
+          break;
+        }
+      }
+      preds[i] = pred;
+      succs[i] = cur;
+    }
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+bool SkipList<T, Comp, Alloc>::UnlinkMarked(
+    size_t level, const T &value, node_type *pred) {
+  // equal elements are not ordered consistently across levels, so sweep the
+  // whole run of them behind pred
+  for (node_type *cur = node_type::Unmark(pred->RawNext(level));
+       cur != tail_ && !comp_(value, cur->value);) {
+    node_type *next = cur->RawNext(level);
+    if (!node_type::IsMarked(next)) {
+      pred = cur;
+      cur = next;
+      continue;
+    }
+    node_type *expected = cur;
+    next = node_type::Unmark(next);
+    if (!pred->CasNext(level, expected, next)) return false;
+    if (level == 0) FixBack(next);
+    cur = next;
+  }
+  return true;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::Unlink(node_type *node) {
+  node_type *preds[kMaxLevel], *succs[kMaxLevel];
+  bool done = false;
+  while (!done) {
+    FindConcurrently(node->value, preds, succs);
+    done = true;
+    for (size_t i = node->level - 1; i != size_t() - 1 && done; --i) {
+      done = UnlinkMarked(i, node->value, preds[i]);
+    }
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::FixBack(node_type *node) {
+  // Point node->back at its current predecessor. Every writer changing the
+  // predecessor calls this afterwards, and the compare-and-swap makes a fix
+  // computed from an outdated back pointer retry.
+  for (;;) {
+    node_type *back = node->Back(), *cur = back;
+    while (cur->IsDeleted()) {
+      cur = cur->Back();
+    }
+    for (node_type *next = cur->Next(0); next != node; next = cur->Next(0)) {
+      if (next == tail_ ||
+          (node != tail_ && comp_(node->value, next->value))) {
+        // node itself has been unlinked in the meantime
+        return;
+      }
+      cur = next;
+    }
+    if (cur == back || node->back.compare_exchange_strong(back, cur)) {
+      return;
+    }
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::Retire(node_type *node) {
+  char *mem = arena_->AllocateAlignedConcurrently(
+      sizeof(RetiredNode), alignof(RetiredNode));
+  auto *retired = new(mem) RetiredNode{
+      node, retired_.load(std::memory_order_relaxed)};
+  while (!retired_.compare_exchange_weak(
+      retired->next, retired,
+      std::memory_order_release, std::memory_order_relaxed)) {}
+}
 
-template<typename T, typename Comp>
-SkipList<T, Comp>::SkipList(Comp comp) :
-    comp_(std::move(comp)), length_(0) {
+template<typename T, typename Comp, typename Alloc>
+SkipList<T, Comp, Alloc>::SkipList(Comp comp, const Alloc &alloc) :
+    comp_(std::move(comp)), arena_(std::make_shared<ArenaType>(alloc)),
+    length_(0), max_level_(1),
+    retired_(nullptr) {
   static_assert(std::is_invocable_v<Comp, const T &, const T &>);
   static_assert(std::is_same_v<
       bool, std::invoke_result_t<Comp, const T &, const T &>>);
   std::random_device rd;
   rand_gen_ = std::mt19937(rd());
-  head_ = new node_type(T(), kMaxLevel, nullptr);
-  tail_ = new node_type(T(), kMaxLevel, head_);
+  head_ = NewSentinel(nullptr);
+  tail_ = NewSentinel(head_);
   for (size_t i = 0; i < kMaxLevel; ++i) {
-    head_->links[i] = tail_;
+    head_->NoBarrierSetNext(i, tail_);
   }
 }
-template<typename T, typename Comp>
-SkipList<T, Comp>::~SkipList() {
-  while (tail_ != nullptr) {
-    node_type *node = tail_->back;
-    delete (tail_);
-    tail_ = node;
+template<typename T, typename Comp, typename Alloc>
+template<typename InputIt, typename>
+SkipList<T, Comp, Alloc>::SkipList(
+    InputIt first, InputIt last, Comp comp, const Alloc &alloc) :
+    SkipList(std::move(comp), alloc) {
+  // the k-th node gets one level more than the number of trailing zeros of
+  // k, which spaces every level evenly like a perfectly balanced tree
+  node_type *prev[kMaxLevel];
+  std::fill_n(prev, kMaxLevel, head_);
+  size_t length = 0, max_level = 1;
+  for (; first != last; ++first) {
+    ++length;
+    size_t level = 1;
+    while (level < kMaxLevel && (length & ((size_t(1) << level) - 1)) == 0) {
+      ++level;
+    }
+    max_level = std::max(max_level, level);
+    node_type *node = NewNode(*first, level, prev[0]);
+    assert(prev[0] == head_ || !comp_(node->value, prev[0]->value));
+    for (size_t i = 0; i < level; ++i) {
+      prev[i]->NoBarrierSetNext(i, node);
+      prev[i] = node;
+    }
   }
-//  ::operator delete(head_, head_->level);
-//  ::operator delete(tail_, tail_->level);
+  for (size_t i = 0; i < kMaxLevel; ++i) {
+    prev[i]->NoBarrierSetNext(i, tail_);
+  }
+  tail_->SetBack(prev[0]);
+  max_level_.store(max_level, std::memory_order_relaxed);
+  length_.store(length, std::memory_order_release);
 }
-template<typename T, typename Comp>
-typename SkipList<T, Comp>::iterator
-SkipList<T, Comp>::Insert(T value) {
-  auto prev = std::make_unique<node_type *[]>(kMaxLevel);;
-  node_type *cur = FindPrev(value, prev.get());
+template<typename T, typename Comp, typename Alloc>
+SkipList<T, Comp, Alloc>::~SkipList() {
+  // concurrently erased nodes are no longer linked, but still own values
+  for (RetiredNode *retired = retired_.load(std::memory_order_acquire);
+       retired != nullptr; retired = retired->next) {
+    DeleteNode(retired->node);
+  }
+  for (node_type *node = head_->NoBarrierNext(0); node != tail_;) {
+    node_type *next = node->NoBarrierNext(0);
+    DeleteNode(node);
+    node = next;
+  }
+  head_->~node_type();
+  tail_->~node_type();
+}
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::Insert(T value) {
+  node_type *prev[kMaxLevel];
+  FindPrev(value, prev);
 //  if (next != tail_ &&
 //      !comp_(next->value, value) &&
 //      !comp_(value, next->value)) {
 //    return end();
 //  }
-  size_t level = RandomLevel();
-  auto *node = new node_type(std::move(value), level, cur);
-  for (size_t i = 0; i < level; ++i) {
-    node->links[i] = prev[i]->links[i];
-    prev[i]->links[i] = node;
+  return iterator(InsertAfter(prev, std::move(value), RandomLevel(rand_gen_)));
+}
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::Insert(iterator hint, T value) {
+  node_type *prev[kMaxLevel];
+  const size_t level = RandomLevel(rand_gen_);
+  if (FindPrevFromHint(hint.node_, value, prev)
+      < std::min(level, MaxLevel())) {
+    // the new tower reaches above the levels the hinted search has seen
+    FindPrev(value, prev);
+  }
+  return iterator(InsertAfter(prev, std::move(value), level));
+}
+template<typename T, typename Comp, typename Alloc>
+template<typename InputIt>
+void SkipList<T, Comp, Alloc>::InsertBatch(InputIt first, InputIt last) {
+  node_type *prev[kMaxLevel];
+  std::fill_n(prev, kMaxLevel, head_);
+  for (; first != last; ++first) {
+    T value(*first);
+    FindPrevFromSplice(value, prev);
+    node_type *node = InsertAfter(
+        prev, std::move(value), RandomLevel(rand_gen_));
+    // the next element of a sorted run follows the new node
+    for (size_t i = 0; i < node->level; ++i) {
+      prev[i] = node;
+    }
   }
-  node->links[0]->back = node;
-  ++length_;
-  return iterator(node);
 }
-template<typename T, typename Comp>
-typename SkipList<T, Comp>::iterator
-SkipList<T, Comp>::Erase(const T &value) {
-  auto prev = std::make_unique<node_type *[]>(kMaxLevel);
-  FindPrev(value, prev.get());
+template<typename T, typename Comp, typename Alloc>
+template<typename K>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::EraseKey(const K &key) {
+  node_type *prev[kMaxLevel];
+  FindPrev(key, prev);
   node_type *first = tail_, *last = first;
-  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
-    for (node_type *node = prev[i]->links[i];
+  for (size_t i = MaxLevel() - 1; i != size_t() - 1; --i) {
+    for (node_type *node = prev[i]->NoBarrierNext(i);
          node != tail_ &&
-             !comp_(node->value, value) &&
-             !comp_(value, node->value);
-         node = prev[i]->links[i]) {
-      prev[i]->links[i] = node->links[i];
+             !comp_(node->value, key) &&
+             !comp_(key, node->value);
+         node = prev[i]->NoBarrierNext(i)) {
+      prev[i]->SetNext(i, node->NoBarrierNext(i));
       if (i == 0) {
         if (first == tail_) {
           first = node;
         }
-        last = node->links[i];
+        last = node->NoBarrierNext(i);
       }
     }
   }
   if (first != last) {
-    last->back = first->back;
+    last->SetBack(first->Back());
     while (first != last) {
       node_type *tmp = first;
-      first = first->links[0];
-//      ::operator delete(tmp, tmp->level);
-      delete tmp;
-      --length_;
+      first = first->NoBarrierNext(0);
+      DeleteNode(tmp);
+      length_.fetch_sub(1, std::memory_order_relaxed);
     }
     return iterator(prev[0]);
   } else {
     return end();
   }
 }
-template<typename T, typename Comp>
-typename SkipList<T, Comp>::iterator
-SkipList<T, Comp>::Erase(iterator it) {
-  auto prev = std::make_unique<node_type *[]>(kMaxLevel);
-  FindPrev(*it, prev.get());
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::Erase(iterator it) {
+  node_type *prev[kMaxLevel];
+  FindPrev(*it, prev);
   bool is_contained = false;
-  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
-    for (node_type *cur = prev[i], *next = cur->links[i];
+  for (size_t i = MaxLevel() - 1; i != size_t() - 1; --i) {
+    for (node_type *cur = prev[i], *next = cur->NoBarrierNext(i);
          next != tail_ &&
              !comp_(next->value, *it) &&
              !comp_(*it, next->value);
-         cur = next, next = cur->links[i]) {
+         cur = next, next = cur->NoBarrierNext(i)) {
       if (next == it.node_) {
         is_contained = true;
-        cur->links[i] = next->links[i];
+        cur->SetNext(i, next->NoBarrierNext(i));
         break;
       }
     }
   }
   if (is_contained) {
-    node_type *back = it.node_->back;
-    it.node_->links[0]->back = back;
-    delete it.node_;
-//    ::operator delete(it.node_, it.node_->level);
-    --length_;
+    node_type *back = it.node_->Back();
+    it.node_->NoBarrierNext(0)->SetBack(back);
+    DeleteNode(it.node_);
+    length_.fetch_sub(1, std::memory_order_relaxed);
     return iterator(back);
   } else {
     return end();
   }
 }
-template<typename T, typename Comp>
-typename SkipList<T, Comp>::iterator
-SkipList<T, Comp>::Find(const T &value) const {
-  node_type *cur = FindPrev(value), *next = cur->links[0];
-  if (next != tail_ &&
-      !comp_(next->value, value) &&
-      !comp_(value, next->value)) {
+template<typename T, typename Comp, typename Alloc>
+template<typename K>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::FindKey(const K &key) const {
+  node_type *next = NextNotLess(FindPrev(key), key);
+  if (next != tail_ && !comp_(key, next->value)) {
     return iterator(next);
   } else {
     return end();
   }
 }
-template<typename T, typename Comp>
-std::pair<typename SkipList<T, Comp>::iterator,
-          typename SkipList<T, Comp>::iterator>
-SkipList<T, Comp>::EqualRange(const T &value) const {
-  node_type *cur = FindPrev(value), *first = cur->links[0], *last = first;
-  while (last != tail_ &&
-      !comp_(last->value, value) &&
-      !comp_(value, last->value)) {
-    last = last->links[0];
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::Find(iterator hint, const T &value) const {
+  node_type *prev[kMaxLevel];
+  FindPrevFromHint(hint.node_, value, prev);
+  node_type *next = NextNotLess(prev[0], value);
+  if (next != tail_ && !comp_(value, next->value)) {
+    return iterator(next);
+  } else {
+    return end();
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::MultiFind(
+    const T *values, size_t n, iterator *result) const {
+  struct Search {
+    node_type *cur;
+    // prefetched a round earlier, compared in this one
+    node_type *next;
+    size_t level;
+  };
+  Search searches[kMultiFindGroupSize];
+  size_t active[kMultiFindGroupSize];
+  const size_t top = MaxLevel() - 1;
+  for (size_t base = 0; base < n; base += kMultiFindGroupSize) {
+    const size_t group = std::min(n - base, kMultiFindGroupSize);
+    node_type *first = head_->Next(top);
+    for (size_t i = 0; i < group; ++i) {
+      searches[i] = Search{head_, first, top};
+      active[i] = i;
+    }
+    // round robin over the unfinished searches, each taking one step
+    for (size_t num_active = group; num_active > 0;) {
+      for (size_t k = 0; k < num_active;) {
+        const size_t i = active[k];
+        Search &search = searches[i];
+        const T &value = values[base + i];
+        if (search.next != tail_ && comp_(search.next->value, value)) {
+          search.cur = search.next;
+          search.next = search.cur->Next(search.level);
+        } else {
+          // levels leading to the same node need no compare
+          node_type *bound = search.next;
+          while (search.level > 0 && search.next == bound) {
+            search.next = search.cur->Next(--search.level);
+          }
+          if (search.next == bound) {
+            node_type *next = NextNotLess(search.cur, value);
+            result[base + i] = next != tail_ &&
+                !comp_(value, next->value) ? iterator(next) : end();
+            active[k] = active[--num_active];
+            continue;
+          }
+        }
+        __builtin_prefetch(search.next);
+        ++k;
+      }
+    }
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+std::pair<typename SkipList<T, Comp, Alloc>::iterator,
+          typename SkipList<T, Comp, Alloc>::iterator>
+SkipList<T, Comp, Alloc>::EqualRange(const T &value) const {
+  return std::make_pair(LowerBound(value), UpperBound(value));
+}
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::LowerBound(const T &value) const {
+  return iterator(NextNotLess(FindPrev(value), value));
+}
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::UpperBound(const T &value) const {
+  return iterator(NextGreater(FindLastNotGreater(value), value));
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ScanIterator::Next() {
+  assert(Valid());
+  SetNode(node_->NextLive());
+  if (ahead_ == nullptr) {
+    ResetAhead();
+  } else if (ahead_ != list_->tail_) {
+    ahead_ = ahead_->NextLive();
+    __builtin_prefetch(ahead_);
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ScanIterator::Prev() {
+  assert(Valid());
+  SetNode(node_->BackLive());
+  ahead_ = nullptr;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ScanIterator::Seek(const T &target) {
+  SetNode(list_->NextNotLess(list_->FindPrev(target), target));
+  ResetAhead();
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ScanIterator::SeekForPrev(const T &target) {
+  node_type *node = list_->FindLastNotGreater(target);
+  SetNode(node->IsDeleted() ? node->BackLive() : node);
+  ahead_ = nullptr;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ScanIterator::SeekToFirst() {
+  SetNode(list_->head_->NextLive());
+  ResetAhead();
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ScanIterator::SeekToLast() {
+  SetNode(list_->tail_->BackLive());
+  ahead_ = nullptr;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ScanIterator::SetNode(node_type *node) {
+  node_ = node == list_->head_ || node == list_->tail_ ? nullptr : node;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ScanIterator::ResetAhead() {
+  ahead_ = nullptr;
+  if (node_ == nullptr || prefetch_distance_ == 0) {
+    return;
+  }
+  // the nodes walked here are touched right away; only the last one is
+  // fetched ahead of its use
+  ahead_ = node_;
+  for (size_t i = 1; i < prefetch_distance_ && ahead_ != list_->tail_; ++i) {
+    ahead_ = ahead_->NextLive();
+  }
+  if (ahead_ != list_->tail_) {
+    ahead_ = ahead_->NextLive();
+    __builtin_prefetch(ahead_);
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+typename SkipList<T, Comp, Alloc>::iterator
+SkipList<T, Comp, Alloc>::InsertConcurrently(T value) {
+  thread_local std::mt19937 rand_gen{std::random_device()()};
+  node_type *preds[kMaxLevel], *succs[kMaxLevel];
+  const size_t level = RandomLevel(rand_gen);
+  // searches fill preds up to the height, so raise it before the first one
+  RaiseMaxLevel(level);
+  FindConcurrently(value, preds, succs);
+  node_type *node = NewNodeConcurrently(std::move(value), level, preds[0]);
+  // the node becomes visible once it is spliced into level 0
+  for (;;) {
+    for (size_t i = 0; i < level; ++i) {
+      node->NoBarrierSetNext(i, succs[i]);
+    }
+    node->back.store(preds[0], std::memory_order_relaxed);
+    node_type *expected = succs[0];
+    if (preds[0]->CasNext(0, expected, node)) break;
+    FindConcurrently(node->value, preds, succs);
+  }
+  length_.fetch_add(1, std::memory_order_relaxed);
+  FixBack(succs[0]);
+  // build the tower; stop early if an eraser has started marking it
+  for (size_t i = 1; i < level; ++i) {
+    for (;;) {
+      node_type *next = node->RawNext(i);
+      if (node_type::IsMarked(next)) break;
+      if (next != succs[i] && !node->CasNext(i, next, succs[i])) continue;
+      node_type *expected = succs[i];
+      if (preds[i]->CasNext(i, expected, node)) break;
+      FindConcurrently(node->value, preds, succs);
+    }
+    if (node_type::IsMarked(node->RawNext(i))) break;
+  }
+  // an eraser may have unlinked the tower before it was complete
+  if (node->IsDeleted()) Unlink(node);
+  return iterator(node);
+}
+template<typename T, typename Comp, typename Alloc>
+bool SkipList<T, Comp, Alloc>::EraseConcurrently(const T &value) {
+  node_type *preds[kMaxLevel], *succs[kMaxLevel];
+  for (;;) {
+    FindConcurrently(value, preds, succs);
+    node_type *victim = succs[0];
+    if (victim == tail_ || comp_(value, victim->value)) return false;
+    // mark the tower top-down, so that no higher level can be linked anew
+    for (size_t i = victim->level - 1; i > 0; --i) {
+      node_type *next = victim->RawNext(i);
+      while (!node_type::IsMarked(next) &&
+          !victim->CasNext(i, next, node_type::Mark(next))) {}
+    }
+    // the thread marking level 0 owns the erasure
+    node_type *next = victim->RawNext(0);
+    while (!node_type::IsMarked(next)) {
+      if (victim->CasNext(0, next, node_type::Mark(next))) {
+        length_.fetch_sub(1, std::memory_order_relaxed);
+        Unlink(victim);
+        Retire(victim);
+        return true;
+      }
+    }
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+size_t SkipList<T, Comp, Alloc>::MemoryUsage() const {
+  size_t usage = arena_->MemoryUsage();
+  for (auto &arena : shared_arenas_) {
+    usage += arena->MemoryUsage();
+  }
+  return usage;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::FindLast(node_type **last) const {
+  node_type *cur = head_;
+  for (size_t i = kMaxLevel - 1; i != size_t() - 1; --i) {
+    for (node_type *next = cur->NoBarrierNext(i);
+         next != tail_; next = cur->NoBarrierNext(i)) {
+      cur = next;
+    }
+    last[i] = cur;
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ShrinkMaxLevel() {
+  size_t level = MaxLevel();
+  while (level > 1 && head_->NoBarrierNext(level - 1) == tail_) {
+    --level;
+  }
+  max_level_.store(level, std::memory_order_relaxed);
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::ShareArenas(const SkipList &other) {
+  auto share = [this](const std::shared_ptr<ArenaType> &arena) {
+    if (arena != arena_ && std::find(shared_arenas_.begin(),
+        shared_arenas_.end(), arena) == shared_arenas_.end()) {
+      shared_arenas_.push_back(arena);
+    }
+  };
+  share(other.arena_);
+  for (auto &arena : other.shared_arenas_) {
+    share(arena);
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+std::unique_ptr<SkipList<T, Comp, Alloc>>
+SkipList<T, Comp, Alloc>::Split(const T &value) {
+  auto result = std::make_unique<SkipList>(
+      comp_, Alloc(arena_->get_allocator()));
+  result->ShareArenas(*this);
+  node_type *prev[kMaxLevel], *last[kMaxLevel];
+  std::fill_n(prev, kMaxLevel, head_);
+  FindPrev(value, prev);
+  FindLast(last);
+  for (size_t i = 0; i < kMaxLevel; ++i) {
+    node_type *first = prev[i]->NoBarrierNext(i);
+    if (first == tail_) continue;
+    result->head_->NoBarrierSetNext(i, first);
+    last[i]->NoBarrierSetNext(i, result->tail_);
+    prev[i]->NoBarrierSetNext(i, tail_);
+  }
+  node_type *first = result->head_->NoBarrierNext(0);
+  if (first == result->tail_) {
+    return result;
+  }
+  first->SetBack(result->head_);
+  result->tail_->SetBack(last[0]);
+  tail_->SetBack(prev[0]);
+  // walk both sides together until the shorter one ends
+  node_type *kept = head_->NoBarrierNext(0), *moved = first;
+  size_t count = 0;
+  while (kept != tail_ && moved != result->tail_) {
+    kept = kept->NoBarrierNext(0);
+    moved = moved->NoBarrierNext(0);
+    ++count;
+  }
+  const size_t length = Size();
+  const size_t moved_length = kept == tail_ ? length - count : count;
+  length_.store(length - moved_length, std::memory_order_relaxed);
+  result->length_.store(moved_length, std::memory_order_relaxed);
+  result->max_level_.store(MaxLevel(), std::memory_order_relaxed);
+  result->ShrinkMaxLevel();
+  ShrinkMaxLevel();
+  return result;
+}
+template<typename T, typename Comp, typename Alloc>
+void SkipList<T, Comp, Alloc>::Join(SkipList *other) {
+  assert(other != this);
+  node_type *first = other->head_->NoBarrierNext(0);
+  if (first == other->tail_) {
+    return;
+  }
+  ShareArenas(*other);
+  node_type *last[kMaxLevel], *other_last[kMaxLevel];
+  FindLast(last);
+  other->FindLast(other_last);
+  assert(last[0] == head_ || !comp_(first->value, last[0]->value));
+  for (size_t i = 0; i < kMaxLevel; ++i) {
+    node_type *other_first = other->head_->NoBarrierNext(i);
+    if (other_first == other->tail_) continue;
+    last[i]->NoBarrierSetNext(i, other_first);
+    other_last[i]->NoBarrierSetNext(i, tail_);
+    other->head_->NoBarrierSetNext(i, other->tail_);
   }
-  return std::make_pair(iterator(first), iterator(last));
+  first->SetBack(last[0]);
+  tail_->SetBack(other_last[0]);
+  other->tail_->SetBack(other->head_);
+  length_.fetch_add(other->Size(), std::memory_order_relaxed);
+  RaiseMaxLevel(other->MaxLevel());
+  other->length_.store(0, std::memory_order_relaxed);
+  other->max_level_.store(1, std::memory_order_relaxed);
 }
 
 }  // namespace yaldb
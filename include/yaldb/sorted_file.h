@@ -0,0 +1,401 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#ifndef YALDB_SORTED_FILE_H_
+#define YALDB_SORTED_FILE_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace yaldb {
+
+namespace impl {
+
+// File layout, all in native byte order:
+//   records     num_records values of T, split into blocks of
+//               records_per_block records
+//   index       first record of every block
+//   filter      bloom filter bits, 8-byte aligned, possibly empty
+//   footer      SortedFileFooter, 8-byte aligned
+struct SortedFileFooter {
+  uint64_t magic;
+  uint64_t record_size;
+  uint64_t num_records;
+  uint64_t records_per_block;
+  uint64_t filter_offset;
+  uint64_t filter_bytes;
+  uint64_t num_probes;
+};
+
+constexpr uint64_t kSortedFileMagic = 0x796c64736f727466;  // "yldsortf"
+
+constexpr size_t AlignUp(size_t n, size_t align) {
+  return (n + align - 1) / align * align;
+}
+
+// murmur3 finalizer, spreading weak hashes like the identity of integers
+inline uint64_t MixHash(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53;
+  h ^= h >> 33;
+  return h;
+}
+
+// Bloom filter probes by double hashing of the two halves of a mixed hash,
+// like leveldb.
+inline void BloomAdd(uint8_t *bits, size_t num_bits, size_t num_probes,
+                     uint64_t hash) {
+  uint32_t h = static_cast<uint32_t>(hash);
+  const uint32_t delta = static_cast<uint32_t>(hash >> 32);
+  for (size_t i = 0; i < num_probes; ++i, h += delta) {
+    const size_t bit = h % num_bits;
+    bits[bit / 8] |= static_cast<uint8_t>(1u << (bit % 8));
+  }
+}
+inline bool BloomMayContain(const uint8_t *bits, size_t num_bits,
+                            size_t num_probes, uint64_t hash) {
+  uint32_t h = static_cast<uint32_t>(hash);
+  const uint32_t delta = static_cast<uint32_t>(hash >> 32);
+  for (size_t i = 0; i < num_probes; ++i, h += delta) {
+    const size_t bit = h % num_bits;
+    if ((bits[bit / 8] & (1u << (bit % 8))) == 0) return false;
+  }
+  return true;
+}
+
+}  // namespace impl
+
+// Streams sorted values into an immutable file that SortedFile maps back,
+// e.g. to persist a SkipList. Values are written as raw bytes, so T must be
+// trivially copyable and hold no pointers, and the file is only readable on
+// machines with the same layout of T. Methods return false once writing has
+// failed.
+template<typename T, typename Comp = std::less<T>,
+    typename Hash = std::hash<T>>
+class SortedFileWriter {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+ public:
+  static constexpr size_t kDefaultBlockSize = 4096;
+  static constexpr size_t kDefaultBitsPerKey = 10;
+
+  // block_size is the bytes covered by an entry of the sparse index, and a
+  // bits_per_key of 0 leaves out the bloom filter
+  explicit SortedFileWriter(size_t block_size = kDefaultBlockSize,
+                            size_t bits_per_key = kDefaultBitsPerKey,
+                            Comp comp = Comp(), Hash hash = Hash()) :
+      comp_(std::move(comp)), hash_(std::move(hash)),
+      records_per_block_(std::max<size_t>(1, block_size / sizeof(T))),
+      bits_per_key_(bits_per_key), file_(nullptr), offset_(0), num_records_(0),
+      ok_(false) {}
+  SortedFileWriter(const SortedFileWriter &) = delete;
+  SortedFileWriter &operator=(const SortedFileWriter &) = delete;
+  // abandons an unfinished file
+  ~SortedFileWriter();
+
+  bool Open(const std::string &path);
+  // values must be added in sorted order
+  bool Add(const T &value);
+  template<typename InputIt>
+  bool Add(InputIt first, InputIt last);
+  // appends the index, the filter and the footer, and closes the file.
+  // Later calls fail until the writer is opened again
+  bool Finish();
+
+ private:
+  bool Write(const void *data, size_t bytes);
+  bool Pad(size_t align);
+
+  Comp comp_;
+  Hash hash_;
+  size_t records_per_block_;
+  size_t bits_per_key_;
+  std::FILE *file_;
+  size_t offset_;
+  size_t num_records_;
+  bool ok_;
+  std::vector<T> index_;
+  std::vector<uint64_t> hashes_;
+  // checks that values are added in order
+  std::optional<T> last_;
+};
+
+template<typename T, typename Comp, typename Hash>
+SortedFileWriter<T, Comp, Hash>::~SortedFileWriter() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+  }
+}
+template<typename T, typename Comp, typename Hash>
+bool SortedFileWriter<T, Comp, Hash>::Open(const std::string &path) {
+  assert(file_ == nullptr);
+  file_ = std::fopen(path.c_str(), "wb");
+  offset_ = 0;
+  num_records_ = 0;
+  index_.clear();
+  hashes_.clear();
+  last_.reset();
+  ok_ = file_ != nullptr;
+  return ok_;
+}
+template<typename T, typename Comp, typename Hash>
+bool SortedFileWriter<T, Comp, Hash>::Add(const T &value) {
+  assert(!last_ || !comp_(value, *last_));
+  last_ = value;
+  if (num_records_ % records_per_block_ == 0) {
+    index_.push_back(value);
+  }
+  if (bits_per_key_ > 0) {
+    hashes_.push_back(impl::MixHash(hash_(value)));
+  }
+  ++num_records_;
+  return Write(&value, sizeof(T));
+}
+template<typename T, typename Comp, typename Hash>
+template<typename InputIt>
+bool SortedFileWriter<T, Comp, Hash>::Add(InputIt first, InputIt last) {
+  for (; first != last && ok_; ++first) {
+    Add(*first);
+  }
+  return ok_;
+}
+template<typename T, typename Comp, typename Hash>
+bool SortedFileWriter<T, Comp, Hash>::Finish() {
+  impl::SortedFileFooter footer{};
+  footer.magic = impl::kSortedFileMagic;
+  footer.record_size = sizeof(T);
+  footer.num_records = num_records_;
+  footer.records_per_block = records_per_block_;
+  Write(index_.data(), index_.size() * sizeof(T));
+  Pad(8);
+  footer.filter_offset = offset_;
+  if (!hashes_.empty()) {
+    const size_t num_bits =
+        impl::AlignUp(std::max<size_t>(64, hashes_.size() * bits_per_key_), 64);
+    // 0.69 ~= ln(2) minimizes the false positive rate
+    footer.num_probes = std::clamp<size_t>(bits_per_key_ * 69 / 100, 1, 30);
+    footer.filter_bytes = num_bits / 8;
+    std::vector<uint8_t> bits(footer.filter_bytes);
+    for (uint64_t hash : hashes_) {
+      impl::BloomAdd(bits.data(), num_bits, footer.num_probes, hash);
+    }
+    Write(bits.data(), bits.size());
+  }
+  Write(&footer, sizeof(footer));
+  const bool ok = file_ != nullptr && std::fclose(file_) == 0 && ok_;
+  file_ = nullptr;
+  ok_ = false;
+  return ok;
+}
+template<typename T, typename Comp, typename Hash>
+bool SortedFileWriter<T, Comp, Hash>::Write(const void *data, size_t bytes) {
+  if (ok_ && bytes > 0) {
+    ok_ = std::fwrite(data, 1, bytes, file_) == bytes;
+    offset_ += bytes;
+  }
+  return ok_;
+}
+template<typename T, typename Comp, typename Hash>
+bool SortedFileWriter<T, Comp, Hash>::Pad(size_t align) {
+  static constexpr char kZeros[8] = {};
+  assert(align <= sizeof(kZeros));
+  return Write(kZeros, impl::AlignUp(offset_, align) - offset_);
+}
+
+// Read-only view of a file written by SortedFileWriter. The file is mapped
+// into memory and its records are used in place, so opening costs no more
+// than validating the footer and later reads are bounded by page faults.
+// Lookups binary search the sparse index first and then a single block,
+// after the bloom filter, if any, has ruled out absent values. All methods
+// except Open may be called concurrently.
+template<typename T, typename Comp = std::less<T>,
+    typename Hash = std::hash<T>>
+class SortedFile {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+ public:
+  using iterator = const T *;
+  using const_iterator = iterator;
+
+  explicit SortedFile(Comp comp = Comp(), Hash hash = Hash()) :
+      comp_(std::move(comp)), hash_(std::move(hash)), base_(nullptr),
+      size_(0), records_(nullptr), index_(nullptr), filter_(nullptr),
+      num_records_(0), records_per_block_(1), num_blocks_(0),
+      filter_bits_(0), num_probes_(0) {}
+  SortedFile(const SortedFile &) = delete;
+  SortedFile &operator=(const SortedFile &) = delete;
+  ~SortedFile() { Close(); }
+
+  // returns false if the file cannot be mapped or was not written for T
+  bool Open(const std::string &path);
+  void Close();
+
+  size_t Size() const { return num_records_; }
+  bool Empty() const { return Size() == 0; }
+
+  iterator begin() const { return records_; }
+  iterator end() const { return records_ + num_records_; }
+
+  // false only if no element equal to value is in the file
+  bool MayContain(const T &value) const;
+  iterator Find(const T &value) const;
+  // first element not less than value
+  iterator LowerBound(const T &value) const;
+  // first element greater than value
+  iterator UpperBound(const T &value) const;
+  std::pair<iterator, iterator> EqualRange(const T &value) const;
+
+ private:
+  // records of the index-th block
+  iterator BlockBegin(size_t index) const {
+    return records_ + index * records_per_block_;
+  }
+  iterator BlockEnd(size_t index) const {
+    return index + 1 < num_blocks_ ? BlockBegin(index + 1) : end();
+  }
+
+  Comp comp_;
+  Hash hash_;
+  void *base_;
+  size_t size_;
+  const T *records_;
+  const T *index_;
+  const uint8_t *filter_;
+  size_t num_records_;
+  size_t records_per_block_;
+  size_t num_blocks_;
+  size_t filter_bits_;
+  size_t num_probes_;
+};
+
+template<typename T, typename Comp, typename Hash>
+bool SortedFile<T, Comp, Hash>::Open(const std::string &path) {
+  Close();
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st {};
+  void *base = MAP_FAILED;
+  if (::fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= sizeof(impl::SortedFileFooter)) {
+    base = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+  if (base == MAP_FAILED) return false;
+  base_ = base;
+  size_ = st.st_size;
+
+  impl::SortedFileFooter footer;
+  const size_t footer_offset = size_ - sizeof(footer);
+  std::memcpy(&footer, static_cast<char *>(base_) + footer_offset,
+              sizeof(footer));
+  const size_t records_bytes = footer.num_records * sizeof(T);
+  const size_t num_blocks = footer.records_per_block == 0 ? 0 :
+      (footer.num_records + footer.records_per_block - 1)
+          / footer.records_per_block;
+  const size_t filter_bits = footer.filter_bytes * 8;
+  if (footer.magic != impl::kSortedFileMagic ||
+      footer.record_size != sizeof(T) ||
+      footer.records_per_block == 0 ||
+      footer.num_records > size_ / sizeof(T) ||
+      footer.filter_offset !=
+          impl::AlignUp(records_bytes + num_blocks * sizeof(T), 8) ||
+      footer.filter_bytes > size_ ||
+      footer.filter_offset + footer.filter_bytes != footer_offset ||
+      (filter_bits > 0 && footer.num_probes == 0)) {
+    Close();
+    return false;
+  }
+  char *base_bytes = static_cast<char *>(base_);
+  records_ = reinterpret_cast<const T *>(base_bytes);
+  index_ = reinterpret_cast<const T *>(base_bytes + records_bytes);
+  filter_ = reinterpret_cast<const uint8_t *>(
+      base_bytes + footer.filter_offset);
+  num_records_ = footer.num_records;
+  records_per_block_ = footer.records_per_block;
+  num_blocks_ = num_blocks;
+  filter_bits_ = filter_bits;
+  num_probes_ = footer.num_probes;
+  // every lookup goes through the index and the filter, so fault them in
+  // ahead of time; the records are left to be read on demand
+  const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  const size_t hot = records_bytes / page * page;
+  ::madvise(base_bytes + hot, size_ - hot, MADV_WILLNEED);
+  return true;
+}
+template<typename T, typename Comp, typename Hash>
+void SortedFile<T, Comp, Hash>::Close() {
+  if (base_ != nullptr) {
+    ::munmap(base_, size_);
+  }
+  base_ = nullptr;
+  size_ = 0;
+  records_ = index_ = nullptr;
+  filter_ = nullptr;
+  num_records_ = num_blocks_ = filter_bits_ = num_probes_ = 0;
+  records_per_block_ = 1;
+}
+template<typename T, typename Comp, typename Hash>
+bool SortedFile<T, Comp, Hash>::MayContain(const T &value) const {
+  return filter_bits_ == 0 ||
+      impl::BloomMayContain(filter_, filter_bits_, num_probes_,
+                            impl::MixHash(hash_(value)));
+}
+template<typename T, typename Comp, typename Hash>
+typename SortedFile<T, Comp, Hash>::iterator
+SortedFile<T, Comp, Hash>::Find(const T &value) const {
+  if (!MayContain(value)) return end();
+  iterator it = LowerBound(value);
+  if (it != end() && !comp_(value, *it)) {
+    return it;
+  }
+  return end();
+}
+template<typename T, typename Comp, typename Hash>
+typename SortedFile<T, Comp, Hash>::iterator
+SortedFile<T, Comp, Hash>::LowerBound(const T &value) const {
+  // the blocks before the first one starting at or after value end with the
+  // last of them, which holds the bound unless it is that block's start
+  const size_t index =
+      std::lower_bound(index_, index_ + num_blocks_, value, comp_) - index_;
+  if (index == 0) return begin();
+  return std::lower_bound(BlockBegin(index - 1), BlockEnd(index - 1),
+                          value, comp_);
+}
+template<typename T, typename Comp, typename Hash>
+typename SortedFile<T, Comp, Hash>::iterator
+SortedFile<T, Comp, Hash>::UpperBound(const T &value) const {
+  const size_t index =
+      std::upper_bound(index_, index_ + num_blocks_, value, comp_) - index_;
+  if (index == 0) return begin();
+  return std::upper_bound(BlockBegin(index - 1), BlockEnd(index - 1),
+                          value, comp_);
+}
+template<typename T, typename Comp, typename Hash>
+std::pair<typename SortedFile<T, Comp, Hash>::iterator,
+          typename SortedFile<T, Comp, Hash>::iterator>
+SortedFile<T, Comp, Hash>::EqualRange(const T &value) const {
+  return std::make_pair(LowerBound(value), UpperBound(value));
+}
+
+}  // namespace yaldb
+
+#endif  // YALDB_SORTED_FILE_H_
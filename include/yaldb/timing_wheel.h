@@ -0,0 +1,172 @@
+//
+// Copyright [2020] <inhzus>
+//
+#ifndef YALDB_TIMING_WHEEL_H_
+#define YALDB_TIMING_WHEEL_H_
+
+#include <cassert>
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+
+namespace yaldb {
+
+namespace impl {
+
+// intrusive links of a timer, embedded in the object that expires
+struct TimerNode {
+  TimerNode *timer_next = nullptr;
+  // the pointer to this node, nullptr while not scheduled
+  TimerNode **timer_pprev = nullptr;
+  // tick the timer fires at
+  uint64_t deadline = 0;
+
+  [[nodiscard]] bool scheduled() const { return timer_pprev != nullptr; }
+};
+
+// Hierarchical timing wheel over ticks. Level l has 64 slots of 64^l ticks
+// each, a timer sits in the level its distance from now falls in, and
+// moves down a level when the slot of its level comes around. Scheduling
+// and cancelling are O(1). Advancing jumps from one occupied slot to the
+// next, so its cost is O(1) per timer moved or fired, however long the
+// wheel was idle. Deadlines beyond the top level wait there, and are placed
+// again when it comes around.
+class TimingWheel {
+ public:
+  explicit TimingWheel(uint64_t now) :
+      now_(now), size_(0), occupied_(), slots_() {}
+  TimingWheel(const TimingWheel &) = delete;
+  TimingWheel &operator=(const TimingWheel &) = delete;
+
+  [[nodiscard]] uint64_t now() const { return now_; }
+  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  // fires at the first tick after now if deadline is due already
+  void Schedule(TimerNode *node, uint64_t deadline) {
+    assert(!node->scheduled());
+    node->deadline = deadline;
+    Link(node, now_ + 1);
+    ++size_;
+  }
+  void Cancel(TimerNode *node) {
+    if (!node->scheduled()) return;
+    Unlink(node);
+    --size_;
+  }
+  // moves to tick now, passing the timers due to expire, unscheduled.
+  // expire may cancel other timers
+  template<typename Expire>
+  void Advance(uint64_t now, Expire expire);
+
+ private:
+  static constexpr size_t kSlotBits = 6;
+  static constexpr size_t kSlots = size_t{1} << kSlotBits;
+  static constexpr size_t kLevels = 6;
+
+  // links node into the slot of its deadline, or of earliest if before
+  void Link(TimerNode *node, uint64_t earliest);
+  void Unlink(TimerNode *node);
+  // the first tick after now some occupied slot comes around at
+  [[nodiscard]] uint64_t NextTick() const;
+
+  uint64_t now_;
+  size_t size_;
+  // bit s of level l is set if slots_[l][s] is not empty
+  uint64_t occupied_[kLevels];
+  // heads of singly linked lists, whose nodes point back
+  TimerNode *slots_[kLevels][kSlots];
+};
+
+inline void TimingWheel::Link(TimerNode *node, uint64_t earliest) {
+  const uint64_t deadline = std::max(node->deadline, earliest);
+  const uint64_t distance = deadline - now_;
+  size_t level = 0;
+  while (level + 1 < kLevels && distance >> (kSlotBits * (level + 1)) != 0) {
+    ++level;
+  }
+  uint64_t at = deadline;
+  if (level + 1 == kLevels && distance >> (kSlotBits * kLevels) != 0) {
+    // beyond the top level, wait in the last slot before now comes around
+    at = now_ + (uint64_t{1} << (kSlotBits * kLevels)) - 1;
+  }
+  const size_t slot = (at >> (kSlotBits * level)) & (kSlots - 1);
+  TimerNode *&head = slots_[level][slot];
+  node->timer_next = head;
+  if (head != nullptr) head->timer_pprev = &node->timer_next;
+  node->timer_pprev = &head;
+  head = node;
+  occupied_[level] |= uint64_t{1} << slot;
+}
+inline void TimingWheel::Unlink(TimerNode *node) {
+  TimerNode **pprev = node->timer_pprev;
+  *pprev = node->timer_next;
+  if (node->timer_next != nullptr) {
+    node->timer_next->timer_pprev = pprev;
+  } else if (TimerNode **first = &slots_[0][0];
+             std::less_equal<>()(first, pprev) &&
+             std::less<>()(pprev, first + kLevels * kSlots)) {
+    // the last node of its slot
+    const size_t index = pprev - first;
+    occupied_[index / kSlots] &= ~(uint64_t{1} << index % kSlots);
+  }
+  node->timer_next = nullptr;
+  node->timer_pprev = nullptr;
+}
+inline uint64_t TimingWheel::NextTick() const {
+  uint64_t next = std::numeric_limits<uint64_t>::max();
+  for (size_t level = 0; level < kLevels; ++level) {
+    if (occupied_[level] == 0) continue;
+    const size_t shift = kSlotBits * level;
+    // the first slot of the level to come around, and the ones after
+    const uint64_t from = ((now_ >> shift) + 1) << shift;
+    const int skipped = std::countr_zero(
+        std::rotr(occupied_[level], static_cast<int>(
+            (from >> shift) & (kSlots - 1))));
+    next = std::min(next, from + (static_cast<uint64_t>(skipped) << shift));
+  }
+  return next;
+}
+template<typename Expire>
+void TimingWheel::Advance(uint64_t now, Expire expire) {
+  while (now_ < now) {
+    // nothing happens in the ticks skipped
+    const uint64_t next = NextTick();
+    if (next > now) {
+      now_ = now;
+      return;
+    }
+    now_ = next;
+    // the slots of upper levels coming around move down
+    for (size_t level = 1; level < kLevels; ++level) {
+      const size_t shift = kSlotBits * level;
+      if ((now_ & ((uint64_t{1} << shift) - 1)) != 0) break;
+      // never placed back into the same slot
+      TimerNode *&head = slots_[level][(now_ >> shift) & (kSlots - 1)];
+      while (head != nullptr) {
+        TimerNode *node = head;
+        Unlink(node);
+        // due now if its deadline is, in the slot fired next
+        Link(node, now_);
+      }
+    }
+    TimerNode *&head = slots_[0][now_ & (kSlots - 1)];
+    while (head != nullptr) {
+      TimerNode *node = head;
+      Unlink(node);
+      --size_;
+      assert(node->deadline <= now_);
+      expire(node);
+    }
+  }
+}
+
+}  // namespace impl
+
+}  // namespace yaldb
+
+#endif  // YALDB_TIMING_WHEEL_H_
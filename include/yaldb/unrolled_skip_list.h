@@ -0,0 +1,687 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#ifndef YALDB_UNROLLED_SKIP_LIST_H_
+#define YALDB_UNROLLED_SKIP_LIST_H_
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <type_traits>
+#include <utility>
+
+#include "yaldb/arena.h"
+
+namespace yaldb {
+
+template<typename T, typename Comp, typename Alloc>
+class UnrolledSkipList;
+
+namespace impl {
+
+// Whether sorted keys can be searched by comparing several of them at once:
+// 32 and 64-bit integers ordered by std::less.
+template<typename T, typename Comp>
+struct IsSimdSearchable : std::false_type {};
+template<typename T>
+struct IsSimdSearchable<T, std::less<T>> : std::bool_constant<
+    std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+    (sizeof(T) == 4 || sizeof(T) == 8)> {};
+template<typename T>
+struct IsSimdSearchable<T, std::less<>> : IsSimdSearchable<T, std::less<T>> {};
+
+// Positions inside a sorted array of at most 64 keys, which must stay
+// readable up to a multiple of kPadding keys. The generic version binary
+// searches with the comparator.
+template<typename T, typename Comp, typename = void>
+struct KeySearch {
+  static constexpr size_t kPadding = 1;
+
+  static size_t CountLess(const T *keys, size_t size, const T &value,
+                          const Comp &comp) {
+    return std::lower_bound(keys, keys + size, value, comp) - keys;
+  }
+  static size_t CountNotGreater(const T *keys, size_t size, const T &value,
+                                const Comp &comp) {
+    return std::upper_bound(keys, keys + size, value, comp) - keys;
+  }
+};
+
+// Since the keys are sorted, the lower bound is the number of keys less than
+// value and the upper bound the number not greater. Both are counted without
+// branches, a vector at a time with AVX2 or SSE4.2 when the target has them.
+// The vectors may then read past size up to a multiple of kPadding keys;
+// what they find there is masked out of the count.
+template<typename T, typename Comp>
+struct KeySearch<T, Comp,
+                 std::enable_if_t<IsSimdSearchable<T, Comp>::value>> {
+  static constexpr size_t kPadding = 32 / sizeof(T);
+
+  static size_t CountLess(const T *keys, size_t size, const T &value,
+                          const Comp &) {
+    return std::popcount(CountMask<false>(keys, size, value));
+  }
+  static size_t CountNotGreater(const T *keys, size_t size, const T &value,
+                                const Comp &) {
+    return size - std::popcount(CountMask<true>(keys, size, value));
+  }
+
+ private:
+  // bit i tells keys[i] > value if kGreater, else keys[i] < value
+  template<bool kGreater>
+  static uint64_t CountMask(const T *keys, size_t size, T value) {
+    assert(size <= 64);
+    uint64_t mask = 0;
+#if defined(__AVX2__)
+    constexpr size_t kLanes = 32 / sizeof(T);
+    const __m256i bias = sizeof(T) == 8
+        ? _mm256_set1_epi64x(std::is_signed_v<T> ? 0 : INT64_MIN)
+        : _mm256_set1_epi32(std::is_signed_v<T> ? 0 : INT32_MIN);
+    const __m256i key = _mm256_xor_si256(bias, sizeof(T) == 8
+        ? _mm256_set1_epi64x(static_cast<int64_t>(value))
+        : _mm256_set1_epi32(static_cast<int32_t>(value)));
+    for (size_t i = 0; i < size; i += kLanes) {
+      __m256i run = _mm256_xor_si256(bias, _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(keys + i)));
+      __m256i lhs = kGreater ? run : key, rhs = kGreater ? key : run;
+      uint64_t lanes = sizeof(T) == 8
+          ? _mm256_movemask_pd(_mm256_castsi256_pd(
+              _mm256_cmpgt_epi64(lhs, rhs)))
+          : _mm256_movemask_ps(_mm256_castsi256_ps(
+              _mm256_cmpgt_epi32(lhs, rhs)));
+      mask |= lanes << i;
+    }
+#elif defined(__SSE4_2__)
+    constexpr size_t kLanes = 16 / sizeof(T);
+    const __m128i bias = sizeof(T) == 8
+        ? _mm_set1_epi64x(std::is_signed_v<T> ? 0 : INT64_MIN)
+        : _mm_set1_epi32(std::is_signed_v<T> ? 0 : INT32_MIN);
+    const __m128i key = _mm_xor_si128(bias, sizeof(T) == 8
+        ? _mm_set1_epi64x(static_cast<int64_t>(value))
+        : _mm_set1_epi32(static_cast<int32_t>(value)));
+    for (size_t i = 0; i < size; i += kLanes) {
+      __m128i run = _mm_xor_si128(bias, _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(keys + i)));
+      __m128i lhs = kGreater ? run : key, rhs = kGreater ? key : run;
+      uint64_t lanes = sizeof(T) == 8
+          ? _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(lhs, rhs)))
+          : _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(lhs, rhs)));
+      mask |= lanes << i;
+    }
+#else
+    for (size_t i = 0; i < size; ++i) {
+      mask |= uint64_t(kGreater ? value < keys[i] : keys[i] < value) << i;
+    }
+#endif
+    return size == 64 ? mask : mask & ((uint64_t(1) << size) - 1);
+  }
+};
+
+// A node holds a sorted run of up to kCapacity values in place of a single
+// one. The values come first so that a node aligned to a cache line reads
+// its whole run with one miss. Towers are ordered by the first value of each
+// node, and every value of a node is ordered before those of the next node.
+//
+// With kCacheKeys the tower is followed by the first value of the node each
+// link leads to, so a search only loads the nodes it actually enters rather
+// than also every node it overshoots. Links to the tail cache the largest
+// value of T, which no value is less than.
+template<typename T, size_t kCapacity, bool kCacheKeys>
+struct UnrolledSkipListNode {
+  union {
+    T values[kCapacity];
+  };
+  size_t size;
+  UnrolledSkipListNode *back;
+  size_t level;
+  UnrolledSkipListNode *links[1];
+
+  UnrolledSkipListNode(const size_t level, UnrolledSkipListNode *back) :
+      size(0), back(back), level(level) {
+    for (size_t i = 0; i < level; ++i) {
+      links[i] = nullptr;
+    }
+    if constexpr (kCacheKeys) {
+      std::fill_n(link_keys(), level, std::numeric_limits<T>::max());
+    }
+  }
+  ~UnrolledSkipListNode() {
+    std::destroy_n(values, size);
+  }
+  static constexpr size_t AllocationSize(const size_t level) {
+    return sizeof(UnrolledSkipListNode)
+        + sizeof(UnrolledSkipListNode *) * (level - 1)
+        + (kCacheKeys ? sizeof(T) * level : 0);
+  }
+
+  T *link_keys() {
+    static_assert(kCacheKeys);
+    return reinterpret_cast<T *>(links + level);
+  }
+
+  void InsertAt(size_t pos, T value) {
+    assert(size < kCapacity && pos <= size);
+    if (pos == size) {
+      new(values + size) T(std::move(value));
+    } else {
+      new(values + size) T(std::move(values[size - 1]));
+      std::move_backward(values + pos, values + size - 1, values + size);
+      values[pos] = std::move(value);
+    }
+    ++size;
+  }
+  // removes the values in [first, last)
+  void EraseRange(size_t first, size_t last) {
+    assert(first <= last && last <= size);
+    if (first == last) return;  // moving a value onto itself may clear it
+    std::move(values + last, values + size, values + first);
+    std::destroy(values + size - (last - first), values + size);
+    size -= last - first;
+  }
+  // moves the values from pos on to the empty node dst
+  void MoveTail(size_t pos, UnrolledSkipListNode *dst) {
+    assert(dst->size == 0 && pos <= size);
+    std::uninitialized_move(values + pos, values + size, dst->values);
+    dst->size = size - pos;
+    std::destroy(values + pos, values + size);
+    size = pos;
+  }
+};
+
+template<typename T, size_t kCapacity, bool kCacheKeys>
+class UnrolledSkipListIterator {
+ private:
+  using node_type = UnrolledSkipListNode<T, kCapacity, kCacheKeys>;
+  template<typename U, typename Comp, typename Alloc> friend
+  class ::yaldb::UnrolledSkipList;
+  node_type *node_;
+  size_t index_;
+
+ public:
+  UnrolledSkipListIterator(node_type *node, size_t index) :
+      node_(node), index_(index) {}
+
+  const T &operator*() const { return node_->values[index_]; }
+  const T *operator->() const { return &node_->values[index_]; }
+  UnrolledSkipListIterator &operator++() {
+    // the head holds no values, so stepping from it reaches the first one
+    if (++index_ >= node_->size) {
+      node_ = node_->links[0];
+      index_ = 0;
+    }
+    return *this;
+  }
+  UnrolledSkipListIterator &operator--() {
+    if (index_ == 0) {
+      node_ = node_->back;
+      index_ = node_->size == 0 ? 0 : node_->size - 1;
+    } else {
+      --index_;
+    }
+    return *this;
+  }
+  UnrolledSkipListIterator operator++(int) {  // NOLINT
+    UnrolledSkipListIterator it(*this);
+    ++(*this);
+    return it;
+  }
+  UnrolledSkipListIterator operator--(int) {  // NOLINT
+    UnrolledSkipListIterator it(*this);
+    --(*this);
+    return it;
+  }
+  bool operator==(const UnrolledSkipListIterator &it) const {
+    return node_ == it.node_ && index_ == it.index_;
+  }
+  bool operator!=(const UnrolledSkipListIterator &it) const {
+    return !(*this == it);
+  }
+};
+
+}  // namespace impl
+
+// SkipList whose nodes each store a sorted array of small values filling
+// about a cache line, in the manner of an unrolled linked list or B-skiplist.
+// A lookup pays one miss per visited node instead of one per visited value,
+// and towers and links are amortized over the whole run, which shrinks the
+// memory per value for small keys. A full node is split in two on insertion
+// and an emptied node is unlinked; erasing never merges nodes. Like
+// IndexedSkipList it is single-threaded, and an insertion or erasure
+// invalidates all iterators into the nodes it touches.
+//
+// For 32 and 64-bit integers under std::less, a node is searched by
+// comparing its values with SIMD instructions when the target enables them
+// (build with -mavx2 or -msse4.2), and towers cache the first value of the
+// nodes they link to.
+template<typename T, typename Comp = std::less<T>,
+    typename Alloc = std::allocator<T>>
+class UnrolledSkipList {
+ public:
+  static constexpr size_t kCacheLineSize = 64;
+  static constexpr size_t kNodeCapacity =
+      std::max<size_t>(2, kCacheLineSize / sizeof(T));
+
+  // integer keys ordered by std::less are searched with SIMD inside a node
+  // and cached in the towers along the links
+  static constexpr bool kCacheKeys = impl::IsSimdSearchable<T, Comp>::value;
+
+  using node_type =
+      impl::UnrolledSkipListNode<T, kNodeCapacity, kCacheKeys>;
+  using iterator =
+      impl::UnrolledSkipListIterator<T, kNodeCapacity, kCacheKeys>;
+  using const_iterator = iterator;
+  using allocator_type = Alloc;
+
+ private:
+  using ArenaType = Arena<
+      typename std::allocator_traits<Alloc>::template rebind_alloc<char>>;
+  using Search = impl::KeySearch<T, Comp>;
+  static_assert(kNodeCapacity % Search::kPadding == 0);
+
+  [[nodiscard]] size_t RandomLevel() const;
+  node_type *NewNode(size_t level, node_type *back);
+  static void DeleteNode(node_type *node);
+  // last node whose first value is ordered before value, or the head
+  node_type *FindPrev(const T &value) const;
+  node_type *FindPrev(const T &value, node_type **prev) const;
+  // last node whose first value is not greater than value, or the head
+  node_type *FindLastNotGreater(const T &value) const;
+  // index of the first value of node not less than value
+  size_t LowerBoundIndex(const node_type *node, const T &value) const {
+    return Search::CountLess(node->values, node->size, value, comp_);
+  }
+  // index of the first value of node greater than value
+  size_t UpperBoundIndex(const node_type *node, const T &value) const {
+    return Search::CountNotGreater(node->values, node->size, value, comp_);
+  }
+  // turns one past the end of a node into the start of the next one
+  iterator MakeIterator(node_type *node, size_t index) const;
+  // the nodes linking to node on each of its levels
+  void FindPreds(node_type *node, node_type **preds) const;
+  // links the non-empty node after prev[0], where prev holds the search
+  // path to it
+  void LinkNode(node_type *node, node_type **prev);
+  void UnlinkNode(node_type *node, node_type **preds);
+  // refreshes the keys cached for node after its first value changed
+  void UpdateLinkKeys(node_type *node, node_type **preds);
+
+  static constexpr double kRandomRatio = 0.5;
+  static constexpr size_t kMaxLevel = 32;
+
+  Comp comp_;
+  ArenaType arena_;
+  mutable std::mt19937 rand_gen_;
+  size_t length_;
+  // height of the tallest tower, searches start there instead of at the top
+  size_t max_level_;
+  node_type *head_;
+  node_type *tail_;
+
+ public:
+  explicit UnrolledSkipList(Comp comp = Comp(),  // NOLINT
+                            const Alloc &alloc = Alloc());
+  UnrolledSkipList(const UnrolledSkipList &) = delete;
+  UnrolledSkipList &operator=(const UnrolledSkipList &) = delete;
+  ~UnrolledSkipList();
+
+  size_t Size() const { return length_; }
+  bool Empty() const { return length_ == 0; }
+  // bytes held by the node arena
+  size_t MemoryUsage() const { return arena_.MemoryUsage(); }
+
+  iterator begin() const { return iterator(head_->links[0], 0); }
+  iterator end() const { return iterator(tail_, 0); }
+
+  iterator Insert(T value);
+  // like SkipList, erasing returns the iterator preceding the erased
+  // elements, or end() if nothing was erased
+  iterator Erase(const T &value);
+  iterator Erase(iterator it);
+  iterator Find(const T &value) const;
+  // first element not less than value
+  iterator LowerBound(const T &value) const;
+  // first element greater than value
+  iterator UpperBound(const T &value) const;
+  std::pair<iterator, iterator> EqualRange(const T &value) const;
+};
+
+template<typename T, typename Comp, typename Alloc>
+size_t UnrolledSkipList<T, Comp, Alloc>::RandomLevel() const {
+  size_t level = 1;
+  std::uniform_real_distribution<double> dis(0, 1);
+  while (dis(rand_gen_) < kRandomRatio && level < kMaxLevel) {
+    ++level;
+  }
+  return level;
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::node_type *
+UnrolledSkipList<T, Comp, Alloc>::NewNode(size_t level, node_type *back) {
+  char *mem = arena_.AllocateAligned(
+      node_type::AllocationSize(level),
+      std::max(alignof(node_type), kCacheLineSize));
+  return new(mem) node_type(level, back);
+}
+template<typename T, typename Comp, typename Alloc>
+void UnrolledSkipList<T, Comp, Alloc>::DeleteNode(node_type *node) {
+  // the memory itself is owned by the arena
+  node->~node_type();
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::node_type *
+UnrolledSkipList<T, Comp, Alloc>::FindPrev(const T &value) const {
+  node_type *cur = head_;
+  for (size_t i = max_level_ - 1; i != size_t() - 1; --i) {
+    if constexpr (kCacheKeys) {
+      while (comp_(cur->link_keys()[i], value)) {
+        cur = cur->links[i];
+      }
+    } else {
+      for (node_type *next = cur->links[i];
+           next != tail_ && comp_(next->values[0], value);
+           next = cur->links[i]) {
+        cur = next;
+      }
+    }
+  }
+  return cur;
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::node_type *
+UnrolledSkipList<T, Comp, Alloc>::FindPrev(
+    const T &value, node_type **prev) const {
+  node_type *cur = head_;
+  for (size_t i = max_level_ - 1; i != size_t() - 1; --i) {
+    if constexpr (kCacheKeys) {
+      while (comp_(cur->link_keys()[i], value)) {
+        cur = cur->links[i];
+      }
+    } else {
+      for (node_type *next = cur->links[i];
+           next != tail_ && comp_(next->values[0], value);
+           next = cur->links[i]) {
+        cur = next;
+      }
+    }
+    prev[i] = cur;
+  }
+  return cur;
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::node_type *
+UnrolledSkipList<T, Comp, Alloc>::FindLastNotGreater(const T &value) const {
+  if constexpr (kCacheKeys) {
+    if (value == std::numeric_limits<T>::max()) {
+      // the links to the tail cache this value as well
+      return tail_->back;
+    }
+  }
+  node_type *cur = head_;
+  for (size_t i = max_level_ - 1; i != size_t() - 1; --i) {
+    if constexpr (kCacheKeys) {
+      while (!comp_(value, cur->link_keys()[i])) {
+        cur = cur->links[i];
+      }
+    } else {
+      for (node_type *next = cur->links[i];
+           next != tail_ && !comp_(value, next->values[0]);
+           next = cur->links[i]) {
+        cur = next;
+      }
+    }
+  }
+  return cur;
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::iterator
+UnrolledSkipList<T, Comp, Alloc>::MakeIterator(
+    node_type *node, size_t index) const {
+  if (index == node->size) {
+    return iterator(node->links[0], 0);
+  }
+  return iterator(node, index);
+}
+template<typename T, typename Comp, typename Alloc>
+void UnrolledSkipList<T, Comp, Alloc>::FindPreds(
+    node_type *node, node_type **preds) const {
+  FindPrev(node->values[0], preds);
+  // nodes starting with equal values may precede node on any level
+  for (size_t i = 0; i < node->level; ++i) {
+    while (preds[i]->links[i] != node) {
+      assert(preds[i]->links[i] != tail_);
+      preds[i] = preds[i]->links[i];
+    }
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+void UnrolledSkipList<T, Comp, Alloc>::LinkNode(
+    node_type *node, node_type **prev) {
+  assert(node->size > 0);
+  if (node->level > max_level_) {
+    std::fill(prev + max_level_, prev + node->level, head_);
+    max_level_ = node->level;
+  }
+  for (size_t i = 0; i < node->level; ++i) {
+    node->links[i] = prev[i]->links[i];
+    prev[i]->links[i] = node;
+    if constexpr (kCacheKeys) {
+      node->link_keys()[i] = prev[i]->link_keys()[i];
+      prev[i]->link_keys()[i] = node->values[0];
+    }
+  }
+  node->links[0]->back = node;
+}
+template<typename T, typename Comp, typename Alloc>
+void UnrolledSkipList<T, Comp, Alloc>::UnlinkNode(
+    node_type *node, node_type **preds) {
+  for (size_t i = 0; i < node->level; ++i) {
+    preds[i]->links[i] = node->links[i];
+    if constexpr (kCacheKeys) {
+      preds[i]->link_keys()[i] = node->link_keys()[i];
+    }
+  }
+  node->links[0]->back = node->back;
+}
+template<typename T, typename Comp, typename Alloc>
+void UnrolledSkipList<T, Comp, Alloc>::UpdateLinkKeys(
+    node_type *node, node_type **preds) {
+  if constexpr (kCacheKeys) {
+    for (size_t i = 0; i < node->level; ++i) {
+      preds[i]->link_keys()[i] = node->values[0];
+    }
+  }
+}
+
+template<typename T, typename Comp, typename Alloc>
+UnrolledSkipList<T, Comp, Alloc>::UnrolledSkipList(
+    Comp comp, const Alloc &alloc) :
+    comp_(std::move(comp)), arena_(alloc), length_(0), max_level_(1) {
+  static_assert(std::is_invocable_v<Comp, const T &, const T &>);
+  static_assert(std::is_same_v<
+      bool, std::invoke_result_t<Comp, const T &, const T &>>);
+  std::random_device rd;
+  rand_gen_ = std::mt19937(rd());
+  head_ = NewNode(kMaxLevel, nullptr);
+  tail_ = NewNode(kMaxLevel, head_);
+  for (size_t i = 0; i < kMaxLevel; ++i) {
+    head_->links[i] = tail_;
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+UnrolledSkipList<T, Comp, Alloc>::~UnrolledSkipList() {
+  for (node_type *node = head_; node != nullptr;) {
+    node_type *next = node->links[0];
+    DeleteNode(node);
+    node = next;
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::iterator
+UnrolledSkipList<T, Comp, Alloc>::Insert(T value) {
+  node_type *prev[kMaxLevel];
+  node_type *node = FindPrev(value, prev);
+  ++length_;
+  if (head_->links[0] == tail_) {
+    node = NewNode(RandomLevel(), head_);
+    node->InsertAt(0, std::move(value));
+    LinkNode(node, prev);
+    return iterator(node, 0);
+  }
+  // value ordered before every node becomes the first value of the first
+  // node, whose predecessors are all the head
+  const bool is_first = node == head_;
+  size_t pos = is_first ? 0 : LowerBoundIndex(node, value);
+  if (is_first) {
+    node = head_->links[0];
+  }
+  node_type *split = nullptr, *target = node;
+  if (node->size == kNodeCapacity) {
+    split = NewNode(RandomLevel(), node);
+    if (pos == kNodeCapacity) {
+      // appending keeps the full node intact, so sequential insertion packs
+      // every node
+      target = split;
+      pos = 0;
+    } else {
+      node->MoveTail(kNodeCapacity / 2, split);
+      if (pos > kNodeCapacity / 2) {
+        target = split;
+        pos -= kNodeCapacity / 2;
+      }
+    }
+  }
+  target->InsertAt(pos, std::move(value));
+  if (split != nullptr) {
+    // on every level the split follows node if node reaches it, otherwise
+    // it follows what the search found before node
+    node_type *split_prev[kMaxLevel];
+    for (size_t i = 0; i < std::min(split->level, max_level_); ++i) {
+      split_prev[i] = i < node->level ? node : prev[i];
+    }
+    LinkNode(split, split_prev);
+  }
+  if (is_first) {
+    UpdateLinkKeys(node, prev);
+  }
+  return iterator(target, pos);
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::iterator
+UnrolledSkipList<T, Comp, Alloc>::Erase(const T &value) {
+  iterator first = LowerBound(value);
+  if (first.node_ == tail_ || comp_(value, *first)) return end();
+  node_type *node = first.node_, *back = node->back;
+  size_t pos = first.index_;
+  // erase the run of equal values node by node
+  while (node != tail_) {
+    size_t last = pos;
+    while (last < node->size && !comp_(value, node->values[last])) {
+      ++last;
+    }
+    length_ -= last - pos;
+    node_type *next = node->links[0];
+    const bool is_run_end = last < node->size;
+    node_type *preds[kMaxLevel];
+    if (last - pos == node->size) {
+      FindPreds(node, preds);
+      UnlinkNode(node, preds);
+      DeleteNode(node);
+    } else if (kCacheKeys && pos == 0 && last > 0) {
+      FindPreds(node, preds);
+      node->EraseRange(pos, last);
+      UpdateLinkKeys(node, preds);
+    } else {
+      node->EraseRange(pos, last);
+    }
+    if (is_run_end) break;
+    node = next;
+    pos = 0;
+  }
+  if (first.index_ > 0) {
+    return iterator(first.node_, first.index_ - 1);
+  }
+  return iterator(back, back->size == 0 ? 0 : back->size - 1);
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::iterator
+UnrolledSkipList<T, Comp, Alloc>::Erase(iterator it) {
+  if (it.node_ == tail_) return end();
+  node_type *node = it.node_, *back = node->back;
+  --length_;
+  node_type *preds[kMaxLevel];
+  if (node->size == 1) {
+    FindPreds(node, preds);
+    UnlinkNode(node, preds);
+    DeleteNode(node);
+  } else if (kCacheKeys && it.index_ == 0) {
+    FindPreds(node, preds);
+    node->EraseRange(0, 1);
+    UpdateLinkKeys(node, preds);
+  } else {
+    node->EraseRange(it.index_, it.index_ + 1);
+  }
+  if (it.index_ > 0) {
+    return iterator(node, it.index_ - 1);
+  }
+  return iterator(back, back->size == 0 ? 0 : back->size - 1);
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::iterator
+UnrolledSkipList<T, Comp, Alloc>::Find(const T &value) const {
+  iterator it = LowerBound(value);
+  if (it.node_ != tail_ && !comp_(value, *it)) {
+    return it;
+  } else {
+    return end();
+  }
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::iterator
+UnrolledSkipList<T, Comp, Alloc>::LowerBound(const T &value) const {
+  // the head holds no values, so searching stopping there yields begin()
+  node_type *node = FindPrev(value);
+  return MakeIterator(node, LowerBoundIndex(node, value));
+}
+template<typename T, typename Comp, typename Alloc>
+typename UnrolledSkipList<T, Comp, Alloc>::iterator
+UnrolledSkipList<T, Comp, Alloc>::UpperBound(const T &value) const {
+  node_type *node = FindLastNotGreater(value);
+  return MakeIterator(node, UpperBoundIndex(node, value));
+}
+template<typename T, typename Comp, typename Alloc>
+std::pair<typename UnrolledSkipList<T, Comp, Alloc>::iterator,
+          typename UnrolledSkipList<T, Comp, Alloc>::iterator>
+UnrolledSkipList<T, Comp, Alloc>::EqualRange(const T &value) const {
+  return std::make_pair(LowerBound(value), UpperBound(value));
+}
+
+}  // namespace yaldb
+
+namespace std {
+
+template<typename T, size_t kCapacity, bool kCacheKeys>
+struct iterator_traits<
+    yaldb::impl::UnrolledSkipListIterator<T, kCapacity, kCacheKeys>> {
+  typedef bidirectional_iterator_tag iterator_category;
+  typedef T value_type;
+  typedef ptrdiff_t difference_type;
+  typedef T *pointer;
+  typedef T &reference;
+};
+
+}  // namespace std
+
+#endif  // YALDB_UNROLLED_SKIP_LIST_H_
@@ -0,0 +1,296 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#ifndef YALDB_VERSIONED_SKIP_LIST_H_
+#define YALDB_VERSIONED_SKIP_LIST_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "yaldb/skip_list.h"
+#include "yaldb/thread_annotation.h"
+
+namespace yaldb {
+
+namespace impl {
+
+// One version of an element: a write of value at sequence, or its erasure.
+template<typename T>
+struct VersionedEntry {
+  T value;
+  uint64_t sequence;
+  bool deleted;
+};
+
+// orders entries by value, and the versions of a value newest first
+template<typename T, typename Comp>
+struct VersionedEntryLess {
+  Comp comp;
+
+  bool operator()(const VersionedEntry<T> &lhs,
+                  const VersionedEntry<T> &rhs) const {
+    if (comp(lhs.value, rhs.value)) return true;
+    if (comp(rhs.value, lhs.value)) return false;
+    return lhs.sequence > rhs.sequence;
+  }
+};
+
+}  // namespace impl
+
+// Multi-version set on top of SkipList, like a LSM memtable. Every write is
+// stamped with the next sequence number and kept as a new version: Insert
+// supersedes the elements equal to value and Erase leaves a tombstone. A
+// snapshot pins the latest sequence in O(1), and reads through it ignore
+// every later version, so readers get a point in time view while writes
+// keep landing.
+//
+// Threading follows SkipList: a single writer calls Insert, Erase and
+// Reclaim, while any number of readers call Find, iterate and take or
+// release snapshots. Reclaim unlinks the versions no snapshot can see
+// anymore; like every SkipList erasure, their bytes stay in the arena until
+// the list is destroyed. Reads without a snapshot pin no sequence, and take
+// the newest version of every element as they get to it.
+template<typename T, typename Comp = std::less<T>,
+    typename Alloc = std::allocator<T>>
+class VersionedSkipList {
+ private:
+  using Entry = impl::VersionedEntry<T>;
+  using EntryLess = impl::VersionedEntryLess<T, Comp>;
+  using EntryList = SkipList<Entry, EntryLess,
+      typename std::allocator_traits<Alloc>::template rebind_alloc<Entry>>;
+
+ public:
+  // Handle pinning the sequence it was taken at. Snapshots are owned by the
+  // list and must be released before it is destroyed.
+  class Snapshot {
+   public:
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    uint64_t sequence() const { return sequence_; }
+
+   private:
+    friend class VersionedSkipList;
+
+    explicit Snapshot(uint64_t sequence) :
+        sequence_(sequence), prev_(this), next_(this) {}
+
+    const uint64_t sequence_;
+    // neighbours in the list of live snapshots, oldest first
+    Snapshot *prev_;
+    Snapshot *next_;
+  };
+
+  // Cursor over the newest version of every element visible at a snapshot,
+  // skipping erased elements. Without a snapshot, it is the newest version
+  // linked when the cursor gets to the element.
+  class Iterator {
+   public:
+    explicit Iterator(const VersionedSkipList *list,
+                      const Snapshot *snapshot = nullptr) :
+        list_(list),
+        sequence_(snapshot != nullptr ? snapshot->sequence() : kNewest),
+        it_(&list->list_) {}
+
+    bool Valid() const { return it_.Valid(); }
+    const T &value() const { return it_.value().value; }
+    void Next();
+    // positions at the first element not less than target
+    void Seek(const T &target);
+    void SeekToFirst();
+
+   private:
+    // moves past the remaining versions of value
+    void SkipVersions(const T &value);
+    // skips newer versions, tombstones and the versions they erase
+    void FindVisible();
+
+    const VersionedSkipList *list_;
+    uint64_t sequence_;
+    typename EntryList::ScanIterator it_;
+  };
+
+  explicit VersionedSkipList(Comp comp = Comp(), const Alloc &alloc = Alloc());
+  VersionedSkipList(const VersionedSkipList &) = delete;
+  VersionedSkipList &operator=(const VersionedSkipList &) = delete;
+  ~VersionedSkipList();
+
+  // sequence of the latest write, 0 before the first one
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
+  size_t MemoryUsage() const { return list_.MemoryUsage(); }
+
+  void Insert(T value);
+  void Erase(const T &value);
+  // the newest version equal to value as seen by snapshot, or linked if
+  // none, null if it is absent or erased
+  const T *Find(const T &value, const Snapshot *snapshot = nullptr) const;
+
+  const Snapshot *GetSnapshot();
+  void ReleaseSnapshot(const Snapshot *snapshot);
+  // unlinks the versions hidden from every live snapshot and from the
+  // latest view, returns how many were unlinked
+  size_t Reclaim();
+
+ private:
+  // sequence of the reads without a snapshot, which Reclaim never unlinks
+  // the newest version of an element from under
+  static constexpr uint64_t kNewest = std::numeric_limits<uint64_t>::max();
+
+  uint64_t OldestSequence();
+
+  Comp comp_;
+  EntryList list_;
+  std::atomic<uint64_t> last_sequence_;
+  std::mutex mutex_;
+  // dummy head of the circular list of live snapshots
+  Snapshot snapshots_ GUARDED_BY(mutex_);
+};
+
+template<typename T, typename Comp, typename Alloc>
+void VersionedSkipList<T, Comp, Alloc>::Iterator::Next() {
+  assert(Valid());
+  SkipVersions(value());
+  FindVisible();
+}
+template<typename T, typename Comp, typename Alloc>
+void VersionedSkipList<T, Comp, Alloc>::Iterator::Seek(const T &target) {
+  it_.Seek(Entry{target, sequence_, false});
+  FindVisible();
+}
+template<typename T, typename Comp, typename Alloc>
+void VersionedSkipList<T, Comp, Alloc>::Iterator::SeekToFirst() {
+  it_.SeekToFirst();
+  FindVisible();
+}
+template<typename T, typename Comp, typename Alloc>
+void VersionedSkipList<T, Comp, Alloc>::Iterator::SkipVersions(
+    const T &value) {
+  // value lives in a list node and stays put while the cursor moves
+  do {
+    it_.Next();
+  } while (it_.Valid() && !list_->comp_(value, it_.value().value));
+}
+template<typename T, typename Comp, typename Alloc>
+void VersionedSkipList<T, Comp, Alloc>::Iterator::FindVisible() {
+  while (it_.Valid()) {
+    const Entry &entry = it_.value();
+    if (entry.sequence > sequence_) {
+      it_.Next();
+    } else if (entry.deleted) {
+      SkipVersions(entry.value);
+    } else {
+      return;
+    }
+  }
+}
+
+template<typename T, typename Comp, typename Alloc>
+VersionedSkipList<T, Comp, Alloc>::VersionedSkipList(
+    Comp comp, const Alloc &alloc) :
+    comp_(comp), list_(EntryLess{comp},
+                       typename EntryList::allocator_type(alloc)),
+    last_sequence_(0), snapshots_(0) {}
+template<typename T, typename Comp, typename Alloc>
+VersionedSkipList<T, Comp, Alloc>::~VersionedSkipList() {
+  // every snapshot must have been released
+  assert(snapshots_.next_ == &snapshots_);
+}
+template<typename T, typename Comp, typename Alloc>
+void VersionedSkipList<T, Comp, Alloc>::Insert(T value) {
+  const uint64_t sequence =
+      last_sequence_.load(std::memory_order_relaxed) + 1;
+  list_.Insert(Entry{std::move(value), sequence, false});
+  // readers pin the sequence only once the version is linked
+  last_sequence_.store(sequence, std::memory_order_release);
+}
+template<typename T, typename Comp, typename Alloc>
+void VersionedSkipList<T, Comp, Alloc>::Erase(const T &value) {
+  const uint64_t sequence =
+      last_sequence_.load(std::memory_order_relaxed) + 1;
+  list_.Insert(Entry{value, sequence, true});
+  last_sequence_.store(sequence, std::memory_order_release);
+}
+template<typename T, typename Comp, typename Alloc>
+const T *VersionedSkipList<T, Comp, Alloc>::Find(
+    const T &value, const Snapshot *snapshot) const {
+  const uint64_t sequence =
+      snapshot != nullptr ? snapshot->sequence() : kNewest;
+  // the first version of value not newer than sequence
+  auto it = list_.LowerBound(Entry{value, sequence, false});
+  if (it != list_.end() && !comp_(value, it->value) && !it->deleted) {
+    return &it->value;
+  }
+  return nullptr;
+}
+template<typename T, typename Comp, typename Alloc>
+const typename VersionedSkipList<T, Comp, Alloc>::Snapshot *
+VersionedSkipList<T, Comp, Alloc>::GetSnapshot() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto *snapshot = new Snapshot(LastSequence());
+  snapshot->prev_ = snapshots_.prev_;
+  snapshot->next_ = &snapshots_;
+  snapshots_.prev_->next_ = snapshot;
+  snapshots_.prev_ = snapshot;
+  return snapshot;
+}
+template<typename T, typename Comp, typename Alloc>
+void VersionedSkipList<T, Comp, Alloc>::ReleaseSnapshot(
+    const Snapshot *snapshot) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  snapshot->prev_->next_ = snapshot->next_;
+  snapshot->next_->prev_ = snapshot->prev_;
+  delete snapshot;
+}
+template<typename T, typename Comp, typename Alloc>
+uint64_t VersionedSkipList<T, Comp, Alloc>::OldestSequence() {
+  // snapshots taken after this point pin at least the latest sequence
+  std::lock_guard<std::mutex> guard(mutex_);
+  return snapshots_.next_ == &snapshots_ ?
+         LastSequence() : snapshots_.next_->sequence();
+}
+template<typename T, typename Comp, typename Alloc>
+size_t VersionedSkipList<T, Comp, Alloc>::Reclaim() {
+  const uint64_t oldest = OldestSequence();
+  size_t reclaimed = 0;
+  // newest version of the current value seen by the oldest view; whatever
+  // follows it is hidden from every view
+  const Entry *visible = nullptr;
+  // an erasure seen by every view reads the same as no version at all. It
+  // is unlinked after the versions it hides, which readers would find
+  // without it
+  const Entry *tombstone = nullptr;
+  for (auto it = list_.begin(); it != list_.end();) {
+    // unlinked entries stay readable, they are destroyed with the list
+    const Entry &entry = *it++;
+    if (visible != nullptr && !comp_(visible->value, entry.value)) {
+      list_.EraseConcurrently(entry);
+      ++reclaimed;
+      continue;
+    }
+    if (tombstone != nullptr) {
+      list_.EraseConcurrently(*tombstone);
+      ++reclaimed;
+    }
+    visible = entry.sequence <= oldest ? &entry : nullptr;
+    tombstone = visible != nullptr && entry.deleted ? &entry : nullptr;
+  }
+  if (tombstone != nullptr) {
+    list_.EraseConcurrently(*tombstone);
+    ++reclaimed;
+  }
+  return reclaimed;
+}
+
+}  // namespace yaldb
+
+#endif  // YALDB_VERSIONED_SKIP_LIST_H_
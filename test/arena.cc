@@ -0,0 +1,84 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/arena.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+TEST_CASE("allocation of Arena", "[Arena]") {
+  yaldb::Arena<> arena;
+  REQUIRE(arena.MemoryUsage() == 0);
+
+  std::vector<std::pair<char *, size_t>> allocated;
+  std::mt19937 rand_gen(301);
+  size_t bytes = 0;
+  for (size_t i = 0; i < 10000; ++i) {
+    size_t size = i % 1000 == 0 ? 6000 : rand_gen() % 200 + 1;
+    char *mem = i % 2 == 0 ? arena.Allocate(size) : arena.AllocateAligned(size);
+    if (i % 2 != 0) {
+      REQUIRE(reinterpret_cast<uintptr_t>(mem) % alignof(std::max_align_t)
+                  == 0);
+    }
+    // fill every byte with a pattern derived from its own index
+    std::memset(mem, static_cast<int>(i % 256), size);
+    allocated.emplace_back(mem, size);
+    bytes += size;
+    REQUIRE(arena.MemoryUsage() >= bytes);
+  }
+  for (size_t i = 0; i < allocated.size(); ++i) {
+    auto[mem, size] = allocated[i];
+    for (size_t j = 0; j < size; ++j) {
+      REQUIRE(static_cast<unsigned char>(mem[j]) == i % 256);
+    }
+  }
+}
+
+TEST_CASE("over-aligned allocation of Arena", "[Arena]") {
+  yaldb::Arena<> arena;
+  for (size_t align : {1u, 8u, 64u, 256u}) {
+    arena.Allocate(3);
+    char *small = arena.AllocateAligned(24, align);
+    char *large = arena.AllocateAligned(5000, align);
+    REQUIRE(reinterpret_cast<uintptr_t>(small) % align == 0);
+    REQUIRE(reinterpret_cast<uintptr_t>(large) % align == 0);
+  }
+}
+
+TEST_CASE("concurrent allocation of ConcurrentArena", "[Arena]") {
+  constexpr size_t kThreads = 4, kCount = 5000;
+  yaldb::ConcurrentArena<> arena;
+  std::vector<std::vector<std::pair<char *, size_t>>> allocated(kThreads);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      std::mt19937 rand_gen(t);
+      for (size_t i = 0; i < kCount; ++i) {
+        size_t size = i % 500 == 0 ? 2000 : rand_gen() % 64 + 1;
+        char *mem = arena.AllocateAlignedConcurrently(size, 8);
+        std::memset(mem, static_cast<int>(t), size);
+        allocated[t].emplace_back(mem, size);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  // no two threads were handed overlapping bytes
+  size_t bytes = 0;
+  for (size_t t = 0; t < kThreads; ++t) {
+    for (auto[mem, size] : allocated[t]) {
+      REQUIRE(reinterpret_cast<uintptr_t>(mem) % 8 == 0);
+      for (size_t j = 0; j < size; ++j) {
+        REQUIRE(static_cast<size_t>(mem[j]) == t);
+      }
+      bytes += size;
+    }
+  }
+  REQUIRE(arena.MemoryUsage() >= bytes);
+}
@@ -5,9 +5,44 @@
 #include "yaldb/cache.h"
 #include "catch2/catch.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "yaldb/hash.h"
+
+namespace {
+
+// replays trace through cache, filling it on misses, returns the hit ratio
+double Replay(yaldb::Cache<int> *cache, const std::vector<std::string> &trace) {
+  size_t hits = 0;
+  for (const std::string &key : trace) {
+    if (cache->Get(key) != nullptr) {
+      ++hits;
+    } else {
+      cache->Put(key, 0);
+    }
+  }
+  return static_cast<double>(hits) / trace.size();
+}
+
+}  // namespace
+
 class CacheTest {
  public:
 //  CacheTest() : cache_(new yaldb::impl::LRUCache<int>(kCapacity)) {}
+  ~CacheTest() { delete cache_; }
   void Put(int key, int value) {
     cache_->Put(std::to_string(key), value);
   }
@@ -122,9 +157,627 @@ TEST_CASE_METHOD(CacheTest, "eviction policy of LRU cache") {
   h.reset();
 }
 
+TEST_CASE_METHOD(CacheTest, "pinned entries of LRU cache are kept apart") {
+  constexpr int kPinned = static_cast<int>(kCapacity);
+  std::vector<yaldb::Cache<int>::PairPtr> handles;
+  for (int i = 0; i < kPinned; ++i) {
+    Put(i, i + 1);
+    handles.push_back(cache_->Get(std::to_string(i)));
+  }
+  // with every entry pinned, a new one is the only one to evict
+  Put(kPinned, kPinned + 1);
+  REQUIRE(kNull == Get(kPinned));
+  REQUIRE(1 == deleted_keys_.size());
+  for (int i = 0; i < kPinned; ++i) {
+    REQUIRE(i + 1 == handles[i]->second);
+    REQUIRE(cache_->Get(std::to_string(i)) == handles[i]);
+  }
+
+  // released entries are evicted in the order they were released
+  handles.clear();
+  REQUIRE(1 == deleted_keys_.size());
+  Put(kPinned, kPinned + 1);
+  REQUIRE(kNull == Get(0));
+  REQUIRE(2 == Get(1));
+  REQUIRE(kPinned + 1 == Get(kPinned));
+  REQUIRE(2 == deleted_keys_.size());
+}
+
+TEST_CASE_METHOD(CacheTest, "charges of LRU cache") {
+  cache_->set_capacity(100);
+  cache_->Put("1", 1, 30);
+  cache_->Put("2", 2, 30);
+  cache_->Put("3", 3, 30);
+  REQUIRE(90 == cache_->TotalCharge());
+  // pushes out the oldest two
+  cache_->Put("4", 4, 60);
+  REQUIRE(90 == cache_->TotalCharge());
+  REQUIRE(kNull == Get(1));
+  REQUIRE(kNull == Get(2));
+  REQUIRE(3 == Get(3));
+  // replacing an entry swaps its charge
+  cache_->Put("3", 5, 10);
+  REQUIRE(70 == cache_->TotalCharge());
+  REQUIRE(5 == Del(3));
+  REQUIRE(60 == cache_->TotalCharge());
+
+  // an entry heavier than the whole cache is cached only while pinned
+  cache_->Put("5", 5, 200);
+  REQUIRE(kNull == Get(5));
+  REQUIRE(kNull == Get(4));
+  REQUIRE(0 == cache_->TotalCharge());
+  cache_->Put("6", 6);
+  auto handle = cache_->Get("6");
+  cache_->Put("7", 7, 200);
+  cache_->Put("8", 8, 50);
+  REQUIRE(51 == cache_->TotalCharge());
+  handle.reset();
+  REQUIRE(8 == Get(8));
+  REQUIRE(6 == Get(6));
+}
+
+TEST_CASE("charges of sharded LRU cache", "[Cache]") {
+  constexpr size_t kCapacity = 1 << 20, kCharge = 1000;
+  std::vector<std::string> deleted;
+  auto cache = yaldb::NewLRUCache<int>(
+      kCapacity, [&deleted](std::pair<std::string, int> *pair) {
+        deleted.push_back(pair->first);
+        delete pair;
+      }, 4);
+  for (int i = 0; i < 10000; ++i) {
+    cache->Put(std::to_string(i), i, kCharge);
+    auto value = cache->Get(std::to_string(i));
+    REQUIRE(value != nullptr);
+    REQUIRE(i == value->second);
+    REQUIRE(cache->TotalCharge() <= kCapacity + kCharge * 16);
+  }
+  // every shard is full
+  REQUIRE(cache->TotalCharge() > kCapacity - kCharge * 16);
+  REQUIRE(cache->TotalCharge() + deleted.size() * kCharge ==
+      10000 * kCharge);
+}
+
+TEST_CASE("shards of sharded cache", "[Cache]") {
+  using Sharded = yaldb::impl::ShardedCache<int, yaldb::impl::LRUCache<int>>;
+  REQUIRE(1 == Sharded(100, 0).num_shards());
+  REQUIRE(8 == Sharded(100, 3).num_shards());
+  // clamped to kMaxShardBits
+  REQUIRE(64 == Sharded(100, 20).num_shards());
+  REQUIRE(64 == size_t{1} << Sharded::kMaxShardBits);
+  REQUIRE(Sharded(100).num_shards() ==
+      size_t{1} << Sharded::DefaultShardBits());
+  REQUIRE(Sharded(100).num_shards() >=
+      std::min(64u, std::thread::hardware_concurrency()));
+
+  // keys sharing a prefix spread evenly, as every cache reports
+  constexpr size_t kKeys = 1 << 14;
+  auto cache = yaldb::NewLRUCache<int>(kKeys * 2, 4);
+  REQUIRE(1 == cache->Skew());
+  for (size_t i = 0; i < kKeys; ++i) {
+    cache->Put("table/0001/row/" + std::to_string(i), 0);
+  }
+  const std::vector<size_t> charges = cache->ShardCharges();
+  REQUIRE(16 == charges.size());
+  size_t total = 0;
+  for (size_t charge : charges) {
+    total += charge;
+  }
+  REQUIRE(cache->TotalCharge() == total);
+  REQUIRE(cache->Skew() < 1.1);
+  // a single shard is even
+  yaldb::impl::LRUCache<int> shard(10);
+  shard.Put("key", 0);
+  REQUIRE(std::vector<size_t>{1} == shard.ShardCharges());
+  REQUIRE(1 == shard.Skew());
+}
+
+TEST_CASE("keys of cache as views and hashes", "[Cache]") {
+  const std::string buffer = "table/0001/row/0002";
+  const std::string_view key = std::string_view(buffer).substr(0, 10);
+  const uint64_t hash = yaldb::Hash(key);
+  auto lru = yaldb::NewLRUCache<int>(100);
+  auto clock = yaldb::NewClockCache<int>(100);
+  yaldb::Cache<int> *caches[] = {lru.get(), clock.get()};
+  for (yaldb::Cache<int> *cache : caches) {
+    cache->Put(key, 1, 1, hash);
+    REQUIRE(1 == cache->Get(key)->second);
+    REQUIRE(1 == cache->Get("table/0001")->second);
+    REQUIRE("table/0001" == cache->Get(key, hash)->first);
+    cache->Put(std::string("table/0001"), 2);
+    REQUIRE(2 == cache->Get(key, hash)->second);
+    REQUIRE(nullptr == cache->Get(buffer));
+    REQUIRE(2 == cache->Del(key, hash)->second);
+    REQUIRE(nullptr == cache->Get(key, hash));
+    REQUIRE(0 == cache->TotalCharge());
+  }
+}
+
+TEST_CASE("batches of caches", "[Cache]") {
+  constexpr int kKeys = 300;
+  std::vector<std::string> names;
+  for (int i = 0; i < kKeys * 2; ++i) {
+    names.push_back("key" + std::to_string(i));
+  }
+  std::vector<std::pair<std::string_view, int>> pairs;
+  for (int i = 0; i < kKeys; ++i) {
+    pairs.emplace_back(names[i], i);
+  }
+  // hits, misses and a key asked twice
+  std::vector<std::string_view> keys;
+  for (int i = kKeys / 2; i < kKeys * 3 / 2; ++i) {
+    keys.push_back(names[i]);
+  }
+  keys.push_back(names[0]);
+  keys.push_back(names[0]);
+
+  auto lru = yaldb::NewLRUCache<int>(kKeys * 2, 3);
+  auto tiny_lfu = yaldb::NewTinyLFUCache<int>(kKeys * 2, 3);
+  auto clock = yaldb::NewClockCache<int>(kKeys * 2, 3);
+  yaldb::impl::LRUCache<int> shard(kKeys * 2);
+  yaldb::impl::ClockCache<int> clock_shard(kKeys * 2);
+  yaldb::Cache<int> *caches[] = {
+      lru.get(), tiny_lfu.get(), clock.get(), &shard, &clock_shard};
+  for (yaldb::Cache<int> *cache : caches) {
+    cache->MultiPut(pairs);
+    REQUIRE(kKeys == cache->TotalCharge());
+    auto values = cache->MultiGet(keys);
+    REQUIRE(keys.size() == values.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      const int key = std::stoi(std::string(keys[i].substr(3)));
+      if (key < kKeys) {
+        REQUIRE(keys[i] == values[i]->first);
+        REQUIRE(key == values[i]->second);
+      } else {
+        REQUIRE(nullptr == values[i]);
+      }
+    }
+    values.clear();
+    REQUIRE(cache->MultiGet({}).empty());
+  }
+}
+
+TEST_CASE("batches of sharded caches", "[Cache][!benchmark]") {
+  constexpr int kKeys = 1 << 16, kBatch = 256;
+  std::vector<std::string> names;
+  for (int i = 0; i < kKeys; ++i) {
+    names.push_back("key" + std::to_string(i * 7919));
+  }
+  std::vector<std::string_view> keys(names.begin(), names.end());
+  auto lru = yaldb::NewLRUCache<int>(kKeys * 2, 4);
+  auto clock = yaldb::NewClockCache<int>(kKeys * 2, 4);
+  for (auto *cache : {lru.get(), clock.get()}) {
+    for (int i = 0; i < kKeys; ++i) {
+      cache->Put(keys[i], i);
+    }
+    const std::string name = cache == lru.get() ? "LRU" : "CLOCK";
+    BENCHMARK("Get of " + name) {
+      size_t sum = 0;
+      for (int i = 0; i < kKeys; ++i) {
+        sum += cache->Get(keys[i])->second;
+      }
+      return sum;
+    };
+    BENCHMARK("MultiGet of " + name) {
+      size_t sum = 0;
+      for (int i = 0; i < kKeys; i += kBatch) {
+        for (const auto &value :
+             cache->MultiGet(std::span(keys).subspan(i, kBatch))) {
+          sum += value->second;
+        }
+      }
+      return sum;
+    };
+  }
+}
+
+TEST_CASE("insertion of caches hands out the entry", "[Cache]") {
+  yaldb::impl::LRUCache<int> lru(0);
+  yaldb::impl::ClockCache<int> clock(0);
+  auto sharded = yaldb::NewLRUCache<int>(100);
+  yaldb::Cache<int> *caches[] = {&lru, &clock, sharded.get()};
+  for (yaldb::Cache<int> *cache : caches) {
+    auto handle = cache->Insert("1", 1);
+    REQUIRE("1" == handle->first);
+    REQUIRE(1 == handle->second);
+    auto replaced = cache->Insert("1", 2, 2);
+    REQUIRE(1 == handle->second);
+    REQUIRE(2 == replaced->second);
+  }
+  REQUIRE(2 == sharded->TotalCharge());
+  REQUIRE(2 == sharded->Get("1")->second);
+  // pinned until its handles were dropped, then evicted
+  REQUIRE(nullptr == lru.Get("1"));
+  REQUIRE(0 == lru.TotalCharge());
+  REQUIRE(0 == clock.TotalCharge());
+}
+
+TEST_CASE("handles of caches outlive them", "[Cache]") {
+  std::vector<std::unique_ptr<yaldb::Cache<int>>> caches;
+  caches.push_back(yaldb::NewLRUCache<int>(16, 1));
+  caches.push_back(yaldb::NewTinyLFUCache<int>(16, 1));
+  caches.push_back(yaldb::NewClockCache<int>(16, 1));
+  for (auto &cache : caches) {
+    cache->Put("a", 1);
+    auto handle = cache->Get("a");
+    auto inserted = cache->Insert("b", 2);
+    cache.reset();
+    REQUIRE(1 == handle->second);
+    REQUIRE(2 == inserted->second);
+    handle.reset();
+    inserted.reset();
+  }
+  // the pairs are deleted with their last handles
+  size_t deleted = 0;
+  auto lru = std::make_unique<yaldb::impl::LRUCache<int>>(
+      16, [&deleted](yaldb::Cache<int>::PairType *pair) {
+        ++deleted;
+        delete pair;
+      });
+  lru->Put("a", 1);
+  lru->Put("b", 2);
+  auto handle = lru->Get("a");
+  auto copy = handle;
+  lru.reset();
+  REQUIRE(1 == deleted);
+  handle.reset();
+  REQUIRE(1 == deleted);
+  copy.reset();
+  REQUIRE(2 == deleted);
+}
+
+TEST_CASE("concurrent misses of cache load once", "[Cache]") {
+  constexpr int kThreads = 8;
+  auto cache = yaldb::NewLRUCache<int>(100);
+  std::atomic<int> loads(0), arrived(0), failures(0), mismatches(0);
+  // every caller has missed by the time the loader returns, mostly
+  auto load = [&loads, &arrived](int value) {
+    loads += value >= 0;
+    while (arrived < kThreads) {
+      std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    if (value < 0) throw std::runtime_error("load failed");
+    return value;
+  };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&] {
+      ++arrived;
+      auto value = cache->GetOrLoad("key", [&load] { return load(42); });
+      mismatches += value->second != 42;
+      try {
+        (void) cache->GetOrLoad("bad", [&load] { return load(-1); });
+      } catch (const std::runtime_error &) {
+        ++failures;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  REQUIRE(mismatches == 0);
+  REQUIRE(failures == kThreads);
+  // the value loaded once is cached, a failure is not
+  REQUIRE(loads == 1);
+  REQUIRE(42 == cache->Get("key")->second);
+  REQUIRE(nullptr == cache->Get("bad"));
+  REQUIRE(7 == cache->GetOrLoad("bad", [] { return 7; })->second);
+  REQUIRE(42 == cache->GetOrLoad("key", [] { return 0; })->second);
+}
+
+TEST_CASE("expiration of caches", "[Cache]") {
+  using std::chrono::milliseconds;
+  using std::chrono::seconds;
+  // a fake clock, which only moves when told to
+  std::chrono::steady_clock::time_point now;
+  auto clock = [&now] { return now; };
+  std::default_delete<yaldb::Cache<int>::PairType> deleter;
+  yaldb::impl::LRUCache<int> lru(100, deleter, clock);
+  yaldb::impl::TinyLFUCache<int> tiny_lfu(100, deleter, clock);
+  yaldb::impl::ClockCache<int> clock_shard(100, deleter, clock);
+  yaldb::impl::ShardedCache<int, yaldb::impl::LRUCache<int>> sharded(
+      100, deleter, 2, clock);
+  yaldb::Cache<int> *caches[] = {&lru, &tiny_lfu, &clock_shard, &sharded};
+  for (yaldb::Cache<int> *cache : caches) {
+    now = {};
+    cache->Put("short", 1, milliseconds(10));
+    cache->Put("long", 2, 2, seconds(10));
+    cache->Put("forever", 3);
+    cache->Put("renewed", 4, milliseconds(10));
+    cache->Put("renewed", 5);
+    auto handle = cache->Insert("inserted", 6, 1, milliseconds(10));
+    // a batch weighs the charges given to it, and expires like the rest
+    const size_t charge = cache->TotalCharge();
+    const std::pair<std::string_view, int> batch[] = {{"batch/1", 7},
+                                                      {"batch/2", 8}};
+    const size_t charges[] = {3, 4};
+    cache->MultiPut(batch, charges, milliseconds(10));
+    REQUIRE(charge + 7 == cache->TotalCharge());
+    int loads = 0;
+    auto load = [&loads] { return ++loads; };
+    REQUIRE(1 == cache->GetOrLoad("loaded", load, 1, milliseconds(10))->second);
+
+    now += milliseconds(9);
+    REQUIRE(1 == cache->Get("short")->second);
+    REQUIRE(6 == cache->Get("inserted")->second);
+    REQUIRE(8 == cache->Get("batch/2")->second);
+    REQUIRE(1 == cache->GetOrLoad("loaded", load)->second);
+    // never returned once expired, even within the tick
+    now += milliseconds(1);
+    REQUIRE(nullptr == cache->Get("short"));
+    REQUIRE(nullptr == cache->Get("inserted"));
+    REQUIRE(nullptr == cache->Get("batch/2"));
+    REQUIRE(6 == handle->second);
+    REQUIRE(2 == cache->GetOrLoad("loaded", load)->second);
+    REQUIRE(2 == cache->Get("long")->second);
+    handle.reset();
+
+    now += seconds(10);
+    REQUIRE(nullptr == cache->Get("long"));
+    REQUIRE(3 == cache->Get("forever")->second);
+    REQUIRE(5 == cache->Get("renewed")->second);
+    REQUIRE(2 == cache->Get("loaded")->second);
+  }
+  // reclaimed by the wheel of the shard as writes go by, without being
+  // looked up
+  for (yaldb::Cache<int> *cache : std::span(caches).first(3)) {
+    cache->Put("writer", 0);
+    const size_t charge = cache->TotalCharge();
+    for (int i = 0; i < 50; ++i) {
+      cache->Put(std::to_string(i), i, seconds(1) + milliseconds(i * 100));
+    }
+    REQUIRE(charge + 50 == cache->TotalCharge());
+    now += seconds(3);
+    cache->Put("writer", 0);
+    REQUIRE(charge + 29 == cache->TotalCharge());
+    now += seconds(3);
+    cache->Put("writer", 0);
+    REQUIRE(charge == cache->TotalCharge());
+  }
+}
+
 TEST_CASE_METHOD(CacheTest, "zero size LRU cache") {
   delete cache_;
   cache_ = new yaldb::impl::LRUCache<int>(0);
   Put(1, 100);
   REQUIRE(kNull == Get(1));
 }
+
+TEST_CASE("frequency sketch of W-TinyLFU cache", "[Cache]") {
+  // counters sharing a byte count apart, and saturate without carrying
+  yaldb::impl::FrequencySketch sketch;
+  sketch.EnsureCapacity(1 << 12);
+  constexpr size_t kKeys = 100;
+  for (size_t key = 0; key < kKeys; ++key) {
+    for (size_t i = 0; i < key % 20; ++i) {
+      sketch.Increment(yaldb::Hash(std::to_string(key)));
+    }
+  }
+  size_t exact = 0;
+  for (size_t key = 0; key < kKeys; ++key) {
+    const size_t expected = std::min<size_t>(key % 20, 15);
+    const uint8_t frequency =
+        sketch.Frequency(yaldb::Hash(std::to_string(key)));
+    REQUIRE(frequency >= expected);
+    exact += frequency == expected;
+  }
+  REQUIRE(exact == kKeys);
+  // widening keeps the counts
+  sketch.EnsureCapacity(1 << 14);
+  for (size_t key = 0; key < kKeys; ++key) {
+    REQUIRE(std::min<size_t>(key % 20, 15) ==
+        sketch.Frequency(yaldb::Hash(std::to_string(key))));
+  }
+
+  // counts halve after 10 times the width of additions
+  yaldb::impl::FrequencySketch aged;
+  const uint64_t hot = yaldb::Hash("hot");
+  for (int i = 0; i < 15; ++i) {
+    aged.Increment(hot);
+  }
+  REQUIRE(15 == aged.Frequency(hot));
+  for (int i = 0; i < 145; ++i) {
+    aged.Increment(yaldb::Hash(std::to_string(i)));
+  }
+  REQUIRE(aged.Frequency(hot) >= 7);
+  REQUIRE(aged.Frequency(hot) < 15);
+}
+
+TEST_CASE("W-TinyLFU cache resists scans", "[Cache]") {
+  constexpr int kCapacity = 1000, kHot = 500, kScan = 20000;
+  yaldb::impl::LRUCache<int> lru(kCapacity);
+  yaldb::impl::TinyLFUCache<int> tiny_lfu(kCapacity);
+  std::vector<std::string> hot, scan;
+  for (int i = 0; i < kHot; ++i) {
+    for (int pass = 0; pass < 8; ++pass) {
+      hot.push_back(std::to_string(i));
+    }
+  }
+  std::shuffle(hot.begin(), hot.end(), std::mt19937(22));
+  for (int i = 0; i < kScan; ++i) {
+    scan.push_back("scan" + std::to_string(i));
+  }
+  yaldb::Cache<int> *caches[] = {&lru, &tiny_lfu};
+  for (yaldb::Cache<int> *cache : caches) {
+    Replay(cache, hot);
+    REQUIRE(Replay(cache, scan) == 0);
+    REQUIRE(cache->TotalCharge() == kCapacity);
+  }
+  hot.clear();
+  for (int i = 0; i < kHot; ++i) {
+    hot.push_back(std::to_string(i));
+  }
+  REQUIRE(Replay(&lru, hot) == 0);
+  REQUIRE(Replay(&tiny_lfu, hot) > 0.9);
+}
+
+TEST_CASE("entries of W-TinyLFU cache", "[Cache]") {
+  yaldb::impl::TinyLFUCache<int> cache(100);
+  cache.Put("1", 1, 50);
+  cache.Put("2", 2, 50);
+  REQUIRE(100 == cache.TotalCharge());
+  auto handle = cache.Get("1");
+  REQUIRE(1 == handle->second);
+  REQUIRE(handle == cache.Get("1"));
+  cache.Put("2", 3, 10);
+  REQUIRE(3 == cache.Get("2")->second);
+  REQUIRE(60 == cache.TotalCharge());
+  handle.reset();
+  for (int i = 0; i < 4; ++i) {
+    REQUIRE(1 == cache.Get("1")->second);
+  }
+  // seen more often than any key of the scan, 1 stays
+  for (int i = 0; i < 20; ++i) {
+    cache.Put("scan" + std::to_string(i), i, 20);
+  }
+  REQUIRE(1 == cache.Get("1")->second);
+  REQUIRE(cache.TotalCharge() <= 100);
+  REQUIRE(1 == cache.Del("1")->second);
+  REQUIRE(nullptr == cache.Get("1"));
+  REQUIRE(cache.TotalCharge() <= 50);
+  cache.set_capacity(0);
+  REQUIRE(0 == cache.TotalCharge());
+}
+
+TEST_CASE("second chance of CLOCK cache", "[Cache]") {
+  yaldb::impl::ClockCache<int> cache(3);
+  cache.Put("1", 1);
+  cache.Put("2", 2);
+  cache.Put("3", 3);
+  REQUIRE(1 == cache.Get("1")->second);
+  // the hand passes over 1, which was referenced, and takes 2
+  cache.Put("4", 4);
+  REQUIRE(nullptr == cache.Get("2"));
+  REQUIRE(1 == cache.Get("1")->second);
+  REQUIRE(3 == cache.TotalCharge());
+
+
+  cache.Put("4", 5, 2);
+  REQUIRE(5 == cache.Get("4")->second);
+  REQUIRE(cache.TotalCharge() <= 3);
+  REQUIRE(5 == cache.Del("4")->second);
+  REQUIRE(nullptr == cache.Get("4"));
+
+  // a handle keeps its pair, not its entry
+  auto handle = cache.Get("1");
+  cache.set_capacity(0);
+  REQUIRE(0 == cache.TotalCharge());
+  REQUIRE(nullptr == cache.Get("1"));
+  REQUIRE(1 == handle->second);
+}
+
+TEST_CASE("concurrent reads of CLOCK cache", "[Cache]") {
+  constexpr int kThreads = 4, kKeys = 512, kOps = 20000;
+  auto cache = yaldb::NewClockCache<int>(kKeys / 2);
+  std::atomic<int> mismatches(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&cache, &mismatches, t] {
+      for (int i = 0; i < kOps; ++i) {
+        const int key = (i * 7 + t) % kKeys;
+        const std::string name = std::to_string(key);
+        if (auto value = cache->Get(name); value != nullptr) {
+          mismatches += value->second != key;
+        } else {
+          cache->Put(name, key);
+        }
+        if (i % 64 == 0) cache->Del(name).reset();
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  REQUIRE(mismatches == 0);
+  REQUIRE(cache->TotalCharge() <= kKeys / 2 + 16);
+}
+
+TEST_CASE("concurrent reads of LRU and CLOCK caches",
+          "[Cache][!benchmark]") {
+  constexpr int kKeys = 1 << 12, kOps = 1 << 16;
+  const int max_readers = static_cast<int>(
+      std::max(4u, std::thread::hardware_concurrency()));
+  std::vector<std::string> keys;
+  for (int i = 0; i < kKeys; ++i) {
+    keys.push_back(std::to_string(i));
+  }
+  // every reader reads kOps times keys which all fit in the cache, spread
+  // over all of them or all the same one, so that the time stays flat as
+  // readers double while the reads scale
+  auto read = [&keys](yaldb::Cache<int> *cache, int readers, bool hot) {
+    std::atomic<size_t> sum(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < readers; ++t) {
+      threads.emplace_back([&keys, &sum, cache, hot, t] {
+        size_t local = 0;
+        for (int i = 0; i < kOps; ++i) {
+          local += cache->Get(keys[hot ? 0 : (i * 31 + t) % kKeys])->second;
+        }
+        sum += local;
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    return sum.load();
+  };
+  auto lru = yaldb::NewLRUCache<int>(kKeys * 2);
+  auto clock = yaldb::NewClockCache<int>(kKeys * 2);
+  for (int i = 0; i < kKeys; ++i) {
+    lru->Put(keys[i], i);
+    clock->Put(keys[i], i);
+  }
+  REQUIRE(read(lru.get(), max_readers, false) ==
+      read(clock.get(), max_readers, false));
+
+  // LRU takes the mutex of a shard exclusively, CLOCK shares its lock: both
+  // write the line of the lock, which a hot key makes contended
+  for (bool hot : {false, true}) {
+    for (int readers = 1; readers <= max_readers; readers *= 2) {
+      const std::string name = std::to_string(readers) +
+          (readers == 1 ? " reader" : " readers") +
+          (hot ? " of a hot key" : "");
+      BENCHMARK("LRU with " + name) {
+        return read(lru.get(), readers, hot);
+      };
+      BENCHMARK("CLOCK with " + name) {
+        return read(clock.get(), readers, hot);
+      };
+    }
+  }
+}
+
+TEST_CASE("trace replay of LRU and W-TinyLFU caches", "[Cache][!benchmark]") {
+  constexpr size_t kKeys = 1 << 17, kCapacity = 1 << 13;
+  constexpr size_t kLength = 1 << 20, kScanEvery = 1 << 18, kScan = 1 << 15;
+  // zipfian reads of a key space, with a full scan of cold keys now and
+  // then, like a nightly table scan
+  std::mt19937 rand_gen(23);
+  std::vector<double> weights(kKeys);
+  for (size_t i = 0; i < kKeys; ++i) {
+    weights[i] = 1 / std::pow(i + 1, 0.9);
+  }
+  std::discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+  std::vector<std::string> trace;
+  for (size_t i = 0; i < kLength; ++i) {
+    if (i % kScanEvery == kScanEvery / 2) {
+      for (size_t j = 0; j < kScan; ++j) {
+        trace.push_back("cold" + std::to_string(i + j));
+      }
+    }
+    trace.push_back(std::to_string(zipf(rand_gen)));
+  }
+  const double lru = Replay(
+      yaldb::NewLRUCache<int>(kCapacity).get(), trace);
+  const double tiny_lfu = Replay(
+      yaldb::NewTinyLFUCache<int>(kCapacity).get(), trace);
+  std::printf("hit ratio: LRU %.3f, W-TinyLFU %.3f\n", lru, tiny_lfu);
+  REQUIRE(tiny_lfu > lru);
+
+  BENCHMARK("replay LRU") {
+    return Replay(yaldb::NewLRUCache<int>(kCapacity).get(), trace);
+  };
+  BENCHMARK("replay W-TinyLFU") {
+    return Replay(yaldb::NewTinyLFUCache<int>(kCapacity).get(), trace);
+  };
+}
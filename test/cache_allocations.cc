@@ -0,0 +1,112 @@
+//
+// Copyright [2020] <inhzus>
+//
+// Built as a test binary of its own, yaldb_allocation_test: the operator new
+// replaced below would count the allocations of every test linked with it.
+
+#include "yaldb/cache.h"
+#include "catch2/catch.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+
+#include "yaldb/hash.h"
+
+namespace {
+
+// allocations by operator new while some CountAllocations is alive
+std::atomic<size_t> allocations(0);
+// AddressSanitizer brings its own operator new, see below
+#ifdef __SANITIZE_ADDRESS__
+constexpr size_t kCounted = 0;
+#else
+constexpr size_t kCounted = 1;
+#endif  // __SANITIZE_ADDRESS__
+std::atomic<int> counters(0);
+
+// counts the allocations of its scope
+class CountAllocations {
+ public:
+  CountAllocations() : before_(allocations.load()) { ++counters; }
+  ~CountAllocations() { --counters; }
+  [[nodiscard]] size_t count() const { return allocations - before_; }
+
+ private:
+  size_t before_;
+};
+
+}  // namespace
+
+// AddressSanitizer brings its own, the count stays 0 under it. Kept out of
+// line, or compilers see the free of inlined deletes as mismatching the new
+// of their callers
+#ifndef __SANITIZE_ADDRESS__
+[[gnu::noinline]] void *operator new(size_t size) {
+  if (counters.load(std::memory_order_relaxed) != 0) ++allocations;
+  if (void *p = std::malloc(size == 0 ? 1 : size)) return p;
+  throw std::bad_alloc();
+}
+[[gnu::noinline]] void *operator new[](size_t size) {
+  return operator new(size);
+}
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, size_t) noexcept {
+  std::free(p);
+}
+[[gnu::noinline]] void operator delete[](void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete[](void *p, size_t) noexcept {
+  std::free(p);
+}
+#endif  // __SANITIZE_ADDRESS__
+
+TEST_CASE("hits of cache allocate nothing", "[Cache]") {
+  const std::string buffer = "table/0001/row/0002";
+  const std::string_view key = std::string_view(buffer).substr(0, 10);
+  const uint64_t hash = yaldb::Hash(key);
+  auto clock = yaldb::NewClockCache<int>(100);
+  clock->Put(key, 1);
+  {
+    CountAllocations counter;
+    for (int i = 0; i < 100; ++i) {
+      REQUIRE(1 == clock->Get(key)->second);
+      REQUIRE(1 == clock->Get(key, hash)->second);
+    }
+    REQUIRE(0 == counter.count());
+  }
+
+  // the first hit of an entry makes the storage of its handles, later fresh
+  // hits put the control block of their handle in it, which the handle
+  // dropped frees again
+  auto lru = yaldb::NewLRUCache<int>(100);
+  auto tiny_lfu = yaldb::NewTinyLFUCache<int>(100);
+  for (yaldb::Cache<int> *cache : {lru.get(), tiny_lfu.get()}) {
+    cache->Put(key, 1);
+    {
+      CountAllocations counter;
+      REQUIRE(1 == cache->Get(key)->second);
+      REQUIRE(kCounted == counter.count());
+    }
+    CountAllocations counter;
+    for (int i = 0; i < 100; ++i) {
+      REQUIRE(1 == cache->Get(key)->second);
+      REQUIRE(1 == cache->Get(key, hash)->second);
+    }
+    REQUIRE(0 == counter.count());
+  }
+
+  // a hit of a pinned entry shares the handle alive
+  auto handle = lru->Get(key);
+  CountAllocations counter;
+  for (int i = 0; i < 100; ++i) {
+    REQUIRE(handle == lru->Get(key, hash));
+  }
+  REQUIRE(0 == counter.count());
+  // the entry replaced keeps its handle, the new one has a storage too
+  lru->Put(key, 2);
+  REQUIRE(2 == lru->Get(key)->second);
+  REQUIRE(1 == handle->second);
+}
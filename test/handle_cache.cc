@@ -0,0 +1,245 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/handle_cache.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "yaldb/cache.h"
+
+namespace {
+
+// counts the values alive through a shared counter
+class Counted {
+ public:
+  Counted(int value, std::shared_ptr<std::atomic<int>> alive) :
+      value_(value), alive_(std::move(alive)) {
+    ++*alive_;
+  }
+  Counted(Counted &&other) noexcept :
+      value_(other.value_), alive_(std::move(other.alive_)) {}
+  Counted &operator=(Counted &&) = delete;
+  ~Counted() {
+    if (alive_ != nullptr) --*alive_;
+  }
+
+  int value() const { return value_; }
+
+ private:
+  int value_;
+  std::shared_ptr<std::atomic<int>> alive_;
+};
+
+using Cache = yaldb::HandleCache<Counted>;
+
+// the value of key, or -1 on a miss
+int Get(Cache *cache, int key) {
+  Cache::Handle *handle = cache->Lookup(std::to_string(key));
+  if (handle == nullptr) return -1;
+  const int value = cache->Value(handle).value();
+  cache->Release(handle);
+  return value;
+}
+
+void Put(Cache *cache, int key, int value,
+         const std::shared_ptr<std::atomic<int>> &alive) {
+  cache->Release(cache->Insert(std::to_string(key), Counted(value, alive)));
+}
+
+}  // namespace
+
+TEST_CASE("hit and miss of HandleCache", "[HandleCache]") {
+  auto alive = std::make_shared<std::atomic<int>>(0);
+  {
+    Cache cache(1000);
+    REQUIRE(Get(&cache, 1) == -1);
+    Put(&cache, 100, 101, alive);
+    REQUIRE(Get(&cache, 100) == 101);
+    REQUIRE(Get(&cache, 200) == -1);
+    Put(&cache, 200, 201, alive);
+    Put(&cache, 100, 102, alive);
+    REQUIRE(Get(&cache, 100) == 102);
+    REQUIRE(Get(&cache, 200) == 201);
+    // the replaced value is gone
+    REQUIRE(*alive == 2);
+    REQUIRE(cache.TotalCharge() == 2);
+
+    Cache::Handle *handle = cache.Lookup("200");
+    REQUIRE(cache.Key(handle) == "200");
+    cache.Release(handle);
+
+    cache.Erase("100");
+    REQUIRE(Get(&cache, 100) == -1);
+    cache.Erase("100");
+    REQUIRE(*alive == 1);
+    REQUIRE(cache.TotalCharge() == 1);
+  }
+  REQUIRE(*alive == 0);
+}
+
+TEST_CASE("handles pin entries of HandleCache", "[HandleCache]") {
+  auto alive = std::make_shared<std::atomic<int>>(0);
+  Cache cache(1000);
+  Put(&cache, 100, 101, alive);
+  Cache::Handle *first = cache.Lookup("100");
+  // a replaced entry lives on while pinned
+  Cache::Handle *second = cache.Insert("100", Counted(102, alive));
+  REQUIRE(cache.Value(first).value() == 101);
+  REQUIRE(cache.Value(second).value() == 102);
+  REQUIRE(*alive == 2);
+  cache.Release(first);
+  REQUIRE(*alive == 1);
+
+  // so does an erased one
+  cache.Erase("100");
+  REQUIRE(Get(&cache, 100) == -1);
+  REQUIRE(cache.Value(second).value() == 102);
+  REQUIRE(*alive == 1);
+  cache.Release(second);
+  REQUIRE(*alive == 0);
+
+  // pruning keeps the pinned entries only
+  Put(&cache, 1, 1, alive);
+  Put(&cache, 2, 2, alive);
+  Cache::Handle *pinned = cache.Lookup("2");
+  cache.Prune();
+  REQUIRE(Get(&cache, 1) == -1);
+  REQUIRE(Get(&cache, 2) == 2);
+  cache.Release(pinned);
+  REQUIRE(*alive == 1);
+}
+
+TEST_CASE("eviction policy of HandleCache", "[HandleCache]") {
+  constexpr int kCapacity = 160;
+  auto alive = std::make_shared<std::atomic<int>>(0);
+  Cache cache(kCapacity);
+  Put(&cache, 100, 101, alive);
+  Put(&cache, 200, 201, alive);
+  Cache::Handle *pinned = cache.Insert("300", Counted(301, alive));
+  // 100 stays the most recently used of its shard and 300 is pinned,
+  // while 200 is pushed out by the rest
+  for (int i = 0; i < kCapacity * 10; ++i) {
+    Put(&cache, 1000 + i, 2000 + i, alive);
+    REQUIRE(Get(&cache, 100) == 101);
+  }
+  REQUIRE(Get(&cache, 200) == -1);
+  REQUIRE(cache.Value(pinned).value() == 301);
+  REQUIRE(Get(&cache, 300) == 301);
+  REQUIRE(cache.TotalCharge() <= kCapacity + 1);
+  cache.Release(pinned);
+  REQUIRE(cache.TotalCharge() <= kCapacity);
+  REQUIRE(*alive == static_cast<int>(cache.TotalCharge()));
+
+  // a heavy entry pushes out several light ones
+  Put(&cache, 2, 2, alive);
+  Cache::Handle *heavy = cache.Insert("2", Counted(3, alive), kCapacity);
+  REQUIRE(cache.TotalCharge() >= kCapacity);
+  cache.Release(heavy);
+  REQUIRE(Get(&cache, 2) == -1);
+}
+
+TEST_CASE("zero size HandleCache", "[HandleCache]") {
+  auto alive = std::make_shared<std::atomic<int>>(0);
+  Cache cache(0);
+  Cache::Handle *handle = cache.Insert("1", Counted(1, alive));
+  // the entry is handed out but never cached
+  REQUIRE(cache.Value(handle).value() == 1);
+  REQUIRE(Get(&cache, 1) == -1);
+  REQUIRE(cache.TotalCharge() == 0);
+  cache.Release(handle);
+  REQUIRE(*alive == 0);
+}
+
+TEST_CASE("shards of HandleCache", "[HandleCache]") {
+  REQUIRE(1 == Cache(100, 0).num_shards());
+  REQUIRE(8 == Cache(100, 3).num_shards());
+  // clamped like the shards of ShardedCache
+  REQUIRE(64 == Cache(100, 20).num_shards());
+  REQUIRE(Cache(100).num_shards() ==
+      size_t{1} << yaldb::impl::DefaultShardBits());
+
+  // a single shard evicts in LRU order across all keys
+  auto alive = std::make_shared<std::atomic<int>>(0);
+  Cache cache(2, 0);
+  Put(&cache, 1, 1, alive);
+  Put(&cache, 2, 2, alive);
+  REQUIRE(Get(&cache, 1) == 1);
+  Put(&cache, 3, 3, alive);
+  REQUIRE(Get(&cache, 2) == -1);
+  REQUIRE(Get(&cache, 1) == 1);
+  REQUIRE(Get(&cache, 3) == 3);
+}
+
+TEST_CASE("concurrent use of HandleCache", "[HandleCache]") {
+  constexpr int kThreads = 4, kKeys = 512, kOps = 20000;
+  auto alive = std::make_shared<std::atomic<int>>(0);
+  std::atomic<int> mismatches(0);
+  {
+    Cache cache(kKeys / 2);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&cache, &alive, &mismatches, t] {
+        for (int i = 0; i < kOps; ++i) {
+          const int key = (i * 7 + t) % kKeys;
+          const std::string name = std::to_string(key);
+          Cache::Handle *handle = cache.Lookup(name);
+          if (handle == nullptr) {
+            handle = cache.Insert(name, Counted(key, alive));
+          }
+          mismatches += cache.Value(handle).value() != key;
+          cache.Release(handle);
+          if (i % 64 == 0) cache.Erase(name);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+  REQUIRE(mismatches == 0);
+  REQUIRE(*alive == 0);
+}
+
+TEST_CASE("benchmark of HandleCache", "[HandleCache][!benchmark]") {
+  constexpr int kKeys = 1 << 16;
+  std::vector<std::string> keys;
+  for (int i = 0; i < kKeys; ++i) {
+    keys.push_back("key" + std::to_string(i * 7919));
+  }
+  BENCHMARK("LRUCache") {
+    yaldb::impl::LRUCache<int> cache(kKeys / 2);
+    int sum = 0;
+    for (int i = 0; i < kKeys * 2; ++i) {
+      const std::string &key = keys[(i * 31) % kKeys];
+      if (auto value = cache.Get(key); value != nullptr) {
+        sum += value->second;
+      } else {
+        cache.Put(key, i);
+      }
+    }
+    return sum;
+  };
+  BENCHMARK("HandleCache") {
+    yaldb::HandleCache<int> cache(kKeys / 2);
+    int sum = 0;
+    for (int i = 0; i < kKeys * 2; ++i) {
+      const std::string &key = keys[(i * 31) % kKeys];
+      auto *handle = cache.Lookup(key);
+      if (handle == nullptr) {
+        handle = cache.Insert(key, i);
+      } else {
+        sum += cache.Value(handle);
+      }
+      cache.Release(handle);
+    }
+    return sum;
+  };
+}
@@ -0,0 +1,58 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/hash.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+TEST_CASE("keys of any length hash apart", "[Hash]") {
+  std::string key;
+  std::unordered_set<uint64_t> hashes;
+  // every length up to several rounds of 48 bytes, and every byte
+  for (size_t len = 0; len < 160; ++len) {
+    REQUIRE(yaldb::Hash(key) == yaldb::Hash(std::string(key)));
+    REQUIRE(hashes.insert(yaldb::Hash(key)).second);
+    for (size_t i = 0; i < len; ++i) {
+      std::string flipped = key;
+      flipped[i] ^= 1;
+      REQUIRE(hashes.insert(yaldb::Hash(flipped)).second);
+    }
+    key.push_back(static_cast<char>('a' + len % 26));
+  }
+  REQUIRE(yaldb::Hash("key", 1) != yaldb::Hash("key", 2));
+}
+
+TEST_CASE("high bits of Hash spread similar keys", "[Hash]") {
+  constexpr size_t kBuckets = 64, kKeys = 1 << 16;
+  // keys sharing a long prefix and differing in a few digits
+  std::vector<size_t> counts(kBuckets);
+  for (size_t i = 0; i < kKeys; ++i) {
+    const std::string key = "user/profile/" + std::to_string(i * 64);
+    ++counts[yaldb::Hash(key) >> 58];
+  }
+  const auto [min, max] = std::minmax_element(counts.begin(), counts.end());
+  REQUIRE(*min > kKeys / kBuckets * 9 / 10);
+  REQUIRE(*max < kKeys / kBuckets * 11 / 10);
+}
+
+TEST_CASE("benchmark of Hash", "[Hash][!benchmark]") {
+  for (size_t len : {8, 32, 256}) {
+    const std::string key(len, 'k');
+    BENCHMARK("Hash of " + std::to_string(len) + " bytes") {
+      return yaldb::Hash(key);
+    };
+    BENCHMARK("polynomial hash of " + std::to_string(len) + " bytes") {
+      size_t hash = 0;
+      for (char ch : key) {
+        hash = hash * 101 + ch;
+      }
+      return hash;
+    };
+  }
+}
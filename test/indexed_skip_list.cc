@@ -0,0 +1,152 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/indexed_skip_list.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+TEST_CASE("positional queries of IndexedSkipList", "[IndexedSkipList]") {
+  yaldb::IndexedSkipList<int> skip_list;
+  std::vector<int> expected;
+  std::mt19937 rand_gen(7);
+  constexpr int kRange = 300;
+  for (size_t round = 0; round < 3000; ++round) {
+    int value = static_cast<int>(rand_gen() % kRange);
+    if (rand_gen() % 3 != 0) {
+      REQUIRE(*skip_list.Insert(value) == value);
+      expected.insert(
+          std::upper_bound(expected.begin(), expected.end(), value), value);
+    } else if (rand_gen() % 2 == 0) {
+      auto[first, last] = std::equal_range(
+          expected.begin(), expected.end(), value);
+      REQUIRE((skip_list.Erase(value) == skip_list.end()) == (first == last));
+      expected.erase(first, last);
+    } else if (!expected.empty()) {
+      size_t k = rand_gen() % expected.size();
+      REQUIRE(skip_list.Erase(skip_list.At(k)) != skip_list.end());
+      expected.erase(expected.begin() + static_cast<ptrdiff_t>(k));
+    }
+    REQUIRE(skip_list.Size() == expected.size());
+
+    int lo = static_cast<int>(rand_gen() % kRange);
+    int hi = static_cast<int>(rand_gen() % kRange);
+    auto lower = std::lower_bound(expected.begin(), expected.end(), lo);
+    REQUIRE(skip_list.Rank(lo) ==
+        static_cast<size_t>(lower - expected.begin()));
+    REQUIRE(skip_list.CountRange(lo, hi) == (lo < hi ? static_cast<size_t>(
+        std::lower_bound(expected.begin(), expected.end(), hi) - lower) : 0));
+    if (!expected.empty()) {
+      size_t k = rand_gen() % expected.size();
+      REQUIRE(*skip_list.At(k) == expected[k]);
+    }
+    REQUIRE(skip_list.At(expected.size()) == skip_list.end());
+  }
+  REQUIRE(std::equal(skip_list.begin(), skip_list.end(),
+                     expected.begin(), expected.end()));
+}
+
+TEST_CASE("IndexedSkipList with a custom comparator", "[IndexedSkipList]") {
+  // descending order, default constructed by the list
+  struct Greater {
+    bool operator()(int lhs, int rhs) const { return lhs > rhs; }
+  };
+  yaldb::IndexedSkipList<int, Greater> skip_list;
+  for (int i = 0; i < 100; ++i) {
+    skip_list.Insert(i);
+  }
+  REQUIRE(*skip_list.At(0) == 99);
+  REQUIRE(*skip_list.At(99) == 0);
+  REQUIRE(skip_list.At(100) == skip_list.end());
+  // 30 is preceded by 99..31
+  REQUIRE(skip_list.Rank(30) == 69);
+  REQUIRE(skip_list.CountRange(80, 20) == 60);
+  REQUIRE(skip_list.CountRange(20, 80) == 0);
+  REQUIRE(std::is_sorted(skip_list.begin(), skip_list.end(), Greater()));
+}
+
+TEST_CASE("random access advance of IndexedSkipList", "[IndexedSkipList]") {
+  yaldb::IndexedSkipList<size_t> skip_list;
+  constexpr size_t kLength = 1000;
+  for (size_t i = 0; i < kLength; ++i) {
+    skip_list.Insert(kLength - i - 1);
+  }
+  auto begin = skip_list.begin(), end = skip_list.end();
+  REQUIRE(end - begin == static_cast<ptrdiff_t>(kLength));
+  for (size_t i = 0; i < kLength; i += 7) {
+    auto it = begin + static_cast<ptrdiff_t>(i);
+    REQUIRE(*it == i);
+    REQUIRE(it - begin == static_cast<ptrdiff_t>(i));
+    REQUIRE(end - it == static_cast<ptrdiff_t>(kLength - i));
+    REQUIRE(*(it - static_cast<ptrdiff_t>(i / 2)) == i - i / 2);
+    REQUIRE(it + static_cast<ptrdiff_t>(kLength - i) == end);
+    REQUIRE(end - static_cast<ptrdiff_t>(kLength - i) == it);
+  }
+  // random access, for the functions of the standard library
+  static_assert(std::is_same_v<
+      std::random_access_iterator_tag,
+      std::iterator_traits<decltype(begin)>::iterator_category>);
+  REQUIRE(std::distance(begin, end) == static_cast<ptrdiff_t>(kLength));
+  for (size_t i = 0; i < kLength; i += 11) {
+    auto it = begin;
+    std::advance(it, static_cast<ptrdiff_t>(i));
+    REQUIRE(*it == i);
+    REQUIRE(std::distance(it, end) == static_cast<ptrdiff_t>(kLength - i));
+    REQUIRE(std::next(it, 3) == it + 3);
+    REQUIRE(std::prev(end, static_cast<ptrdiff_t>(kLength - i)) == it);
+    REQUIRE(begin[static_cast<ptrdiff_t>(i)] == i);
+    REQUIRE(it[0] == i);
+    REQUIRE((begin <= it && it < end && end > it && it >= begin));
+    REQUIRE_FALSE((it < it || it > it));
+    REQUIRE(std::lower_bound(begin, end, i) == it);
+  }
+  // default constructible, as generic code declares iterators first
+  static_assert(std::random_access_iterator<decltype(begin)>);
+  decltype(begin) lo, hi;
+  lo = begin;
+  hi = end;
+  REQUIRE(std::distance(lo, hi) == static_cast<ptrdiff_t>(kLength));
+  REQUIRE(*std::lower_bound(lo, hi, 500) == 500);
+  REQUIRE(std::is_sorted(lo, hi));
+  REQUIRE(std::binary_search(lo, hi, kLength - 1));
+  REQUIRE(std::ranges::upper_bound(lo, hi, 500) - lo == 501);
+  REQUIRE(std::ranges::is_sorted(skip_list));
+  auto[first, last] = skip_list.EqualRange(500);
+  REQUIRE(last - first == 1);
+  REQUIRE(skip_list.Find(500) == first);
+  REQUIRE(skip_list.Find(kLength) == skip_list.end());
+}
+
+TEST_CASE("values of IndexedSkipList are destroyed once", "[IndexedSkipList]") {
+  static size_t alive = 0;
+  struct Counted {
+    size_t key;
+    // not default constructible: the sentinels hold no value
+    explicit Counted(size_t key) : key(key) { ++alive; }
+    Counted(const Counted &c) : key(c.key) { ++alive; }
+    ~Counted() { --alive; }
+    bool operator<(const Counted &c) const { return key < c.key; }
+  };
+  constexpr size_t kLength = 1000;
+  {
+    yaldb::IndexedSkipList<Counted> skip_list;
+    REQUIRE(alive == 0);
+    for (size_t i = 0; i < kLength; ++i) {
+      skip_list.Insert(Counted(i));
+    }
+    REQUIRE(alive == kLength);
+    for (size_t i = 0; i < kLength; i += 2) {
+      REQUIRE(skip_list.Erase(Counted(i)) != skip_list.end());
+    }
+    REQUIRE(alive == kLength / 2);
+    REQUIRE(skip_list.At(10)->key == 21);
+    REQUIRE(skip_list.Rank(Counted(21)) == 10);
+  }
+  REQUIRE(alive == 0);
+}
@@ -0,0 +1,111 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/merging_iterator.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "yaldb/skip_list.h"
+
+namespace {
+
+// orders versions of a key by the key alone
+struct KeyLess {
+  bool operator()(const std::pair<size_t, size_t> &lhs,
+                  const std::pair<size_t, size_t> &rhs) const {
+    return lhs.first < rhs.first;
+  }
+};
+
+}  // namespace
+
+TEST_CASE("merging of SkipLists", "[MergingIterator]") {
+  constexpr size_t kNumLists = 5, kLength = 3000;
+  std::mt19937 rand_gen(16);
+  std::vector<std::unique_ptr<yaldb::SkipList<size_t>>> lists;
+  std::vector<const yaldb::SkipList<size_t> *> sources;
+  std::vector<size_t> expected;
+  for (size_t i = 0; i < kNumLists; ++i) {
+    lists.push_back(std::make_unique<yaldb::SkipList<size_t>>());
+    sources.push_back(lists.back().get());
+    // leave one list empty
+    for (size_t j = 0; i != 2 && j < kLength; ++j) {
+      size_t key = rand_gen() % kLength;
+      lists.back()->Insert(key);
+      expected.push_back(key);
+    }
+  }
+  std::sort(expected.begin(), expected.end());
+
+  yaldb::MergingIterator<size_t> it(sources);
+  REQUIRE_FALSE(it.Valid());
+  std::vector<size_t> merged;
+  for (it.SeekToFirst(); it.Valid(); it.Next()) {
+    merged.push_back(it.value());
+  }
+  REQUIRE(merged == expected);
+
+  const size_t target = kLength / 3;
+  merged.clear();
+  for (it.Seek(target); it.Valid(); it.Next()) {
+    merged.push_back(it.value());
+  }
+  REQUIRE(std::equal(merged.begin(), merged.end(),
+                     std::lower_bound(expected.begin(), expected.end(), target),
+                     expected.end()));
+
+  yaldb::MergingIterator<size_t> unique(sources, true);
+  expected.erase(std::unique(expected.begin(), expected.end()),
+                 expected.end());
+  merged.clear();
+  for (unique.SeekToFirst(); unique.Valid(); unique.Next()) {
+    merged.push_back(unique.value());
+  }
+  REQUIRE(merged == expected);
+
+  yaldb::MergingIterator<size_t> none({});
+  none.SeekToFirst();
+  REQUIRE_FALSE(none.Valid());
+}
+
+TEST_CASE("newest version wins in MergingIterator", "[MergingIterator]") {
+  constexpr size_t kNumLists = 4, kKeys = 1000;
+  using Entry = std::pair<size_t, size_t>;
+  using List = yaldb::SkipList<Entry, KeyLess>;
+  std::mt19937 rand_gen(17);
+  std::vector<std::unique_ptr<List>> lists;
+  std::vector<const List *> sources;
+  // the list with the smallest index holding a key owns its newest version
+  std::map<size_t, size_t> newest;
+  for (size_t i = 0; i < kNumLists; ++i) {
+    lists.push_back(std::make_unique<List>(KeyLess()));
+    sources.push_back(lists.back().get());
+    for (size_t j = 0; j < kKeys / 2; ++j) {
+      size_t key = rand_gen() % kKeys;
+      lists.back()->Insert(Entry(key, i));
+      newest.emplace(key, i);
+    }
+  }
+  yaldb::MergingIterator<Entry, KeyLess> it(sources, true);
+  auto expected = newest.begin();
+  for (it.SeekToFirst(); it.Valid(); it.Next(), ++expected) {
+    REQUIRE(expected != newest.end());
+    REQUIRE(it.value() == Entry(*expected));
+    REQUIRE(it.source() == expected->second);
+  }
+  REQUIRE(expected == newest.end());
+
+  expected = newest.lower_bound(kKeys / 2);
+  for (it.Seek(Entry(kKeys / 2, 0)); it.Valid(); it.Next(), ++expected) {
+    REQUIRE(it.value() == Entry(*expected));
+  }
+  REQUIRE(expected == newest.end());
+}
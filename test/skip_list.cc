@@ -6,8 +6,19 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <functional>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 template<typename T, typename F, std::enable_if_t<
     std::is_invocable_v<F, const T &, const T &> &&
@@ -87,3 +98,686 @@ TEST_CASE("erasing element and related components of SkipList", "[SkipList]") {
     }
   }
 }
+
+TEST_CASE("node memory of SkipList comes from its arena", "[SkipList]") {
+  static size_t alive = 0;
+  struct Counted {
+    std::string payload;
+    // not default constructible: the sentinels hold no value
+    explicit Counted(size_t i) : payload(std::to_string(i)) { ++alive; }
+    Counted(const Counted &c) : payload(c.payload) { ++alive; }
+    Counted(Counted &&c) noexcept : payload(std::move(c.payload)) { ++alive; }
+    ~Counted() { --alive; }
+    bool operator<(const Counted &c) const {
+      return std::stoul(payload) < std::stoul(c.payload);
+    }
+  };
+  constexpr size_t kLength = 4096;
+  {
+    yaldb::SkipList<Counted> skip_list;
+    const size_t empty_usage = skip_list.MemoryUsage();
+    REQUIRE(empty_usage > 0);
+    for (size_t i = 0; i < kLength; ++i) {
+      skip_list.Insert(Counted(i));
+    }
+    REQUIRE(alive == kLength);
+    REQUIRE(skip_list.MemoryUsage() > empty_usage + kLength * sizeof(Counted));
+    // erased nodes destroy their values right away
+    for (size_t i = 0; i < kLength; i += 2) {
+      REQUIRE(skip_list.Erase(Counted(i)) != skip_list.end());
+    }
+    REQUIRE(alive == kLength / 2);
+    size_t expected = 1;
+    for (const Counted &c : skip_list) {
+      REQUIRE(std::stoul(c.payload) == expected);
+      expected += 2;
+    }
+  }
+  REQUIRE(alive == 0);
+}
+
+TEST_CASE("readers run concurrently with a single writer of SkipList",
+          "[SkipList]") {
+  constexpr size_t kLength = 20000, kReaders = 4;
+  yaldb::SkipList<size_t> skip_list;
+  auto inserted = std::make_unique<std::atomic<bool>[]>(kLength);
+  std::vector<size_t> keys(kLength);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(17));
+  std::atomic<bool> done(false);
+  std::atomic<size_t> failures(0);
+
+  std::vector<std::thread> readers;
+  for (size_t r = 0; r < kReaders; ++r) {
+    readers.emplace_back([&, r] {
+      std::mt19937 rand_gen(r);
+      while (!done.load(std::memory_order_acquire)) {
+        // every key published before the lookup must be visible
+        for (size_t i = 0; i < 100; ++i) {
+          size_t key = rand_gen() % kLength;
+          bool expected = inserted[key].load(std::memory_order_acquire);
+          auto it = skip_list.Find(key);
+          if (expected && (it == skip_list.end() || *it != key)) {
+            failures.fetch_add(1);
+          }
+        }
+        // a concurrent scan always observes a sorted sequence
+        size_t count = 0, last = 0;
+        for (auto it = skip_list.begin(); it != skip_list.end(); ++it) {
+          if (count++ != 0 && *it <= last) failures.fetch_add(1);
+          last = *it;
+        }
+        auto[first, second] = skip_list.EqualRange(rand_gen() % kLength);
+        if (first != second && std::next(first) != second) {
+          failures.fetch_add(1);
+        }
+      }
+    });
+  }
+  for (size_t key : keys) {
+    skip_list.Insert(key);
+    inserted[key].store(true, std::memory_order_release);
+  }
+  done.store(true, std::memory_order_release);
+  for (auto &reader : readers) reader.join();
+
+  REQUIRE(failures.load() == 0);
+  REQUIRE(skip_list.Size() == kLength);
+  size_t expected = 0;
+  for (size_t key : skip_list) {
+    REQUIRE(key == expected++);
+  }
+}
+
+TEST_CASE("concurrent writers of SkipList", "[SkipList]") {
+  constexpr size_t kLength = 20000, kWriters = 4;
+  constexpr size_t kRounds = 20, kDuplicates = 20;
+  constexpr size_t kRemaining = kWriters * kRounds * kDuplicates / 2;
+  yaldb::SkipList<size_t> skip_list;
+  std::atomic<bool> done(false);
+  std::atomic<size_t> failures(0);
+
+  std::thread reader([&] {
+    while (!done.load(std::memory_order_acquire)) {
+      size_t count = 0, last = 0;
+      for (auto it = skip_list.begin(); it != skip_list.end(); ++it) {
+        if (count++ != 0 && *it < last) failures.fetch_add(1);
+        last = *it;
+      }
+    }
+  });
+  std::vector<std::thread> writers;
+  for (size_t w = 0; w < kWriters; ++w) {
+    writers.emplace_back([&, w] {
+      for (size_t key = w; key < kLength; key += kWriters) {
+        skip_list.InsertConcurrently(key);
+        if (key / kWriters % (kLength / kWriters / kRounds) == 0) {
+          // every writer fights over the same duplicated value
+          for (size_t i = 0; i < kDuplicates; ++i) {
+            skip_list.InsertConcurrently(kLength);
+          }
+          for (size_t i = 0; i < kDuplicates / 2; ++i) {
+            if (!skip_list.EraseConcurrently(kLength)) failures.fetch_add(1);
+          }
+        }
+      }
+      for (size_t key = w; key < kLength; key += kWriters) {
+        if (key % 3 == 0 && !skip_list.EraseConcurrently(key)) {
+          failures.fetch_add(1);
+        }
+      }
+      if (skip_list.EraseConcurrently(kLength + 1)) failures.fetch_add(1);
+    });
+  }
+  for (auto &writer : writers) writer.join();
+  done.store(true, std::memory_order_release);
+  reader.join();
+  REQUIRE(failures.load() == 0);
+
+  std::vector<size_t> expected;
+  for (size_t key = 0; key < kLength; ++key) {
+    if (key % 3 != 0) expected.push_back(key);
+  }
+  expected.insert(expected.end(), kRemaining, kLength);
+  REQUIRE(skip_list.Size() == expected.size());
+  REQUIRE(std::equal(skip_list.begin(), skip_list.end(),
+                     expected.begin(), expected.end()));
+  // back pointers are exact again once the writers are quiescent
+  auto it = skip_list.end();
+  for (auto rit = expected.rbegin(); rit != expected.rend(); ++rit) {
+    REQUIRE(*--it == *rit);
+  }
+  REQUIRE(it == skip_list.begin());
+
+  REQUIRE(skip_list.Erase(kLength) != skip_list.end());
+  REQUIRE(skip_list.Size() == expected.size() - kRemaining);
+  REQUIRE(skip_list.Find(kLength) == skip_list.end());
+  REQUIRE(*skip_list.Insert(0) == 0);
+  REQUIRE(*skip_list.begin() == 0);
+}
+
+TEST_CASE("concurrent insertion benchmark of SkipList",
+          "[SkipList][!benchmark]") {
+  constexpr size_t kLength = 1 << 18;
+  std::mt19937 rand_gen(3);
+  std::vector<size_t> keys(kLength);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), rand_gen);
+  // the same keys split between more and more writers, so that the time
+  // falls as they double while the insertions scale
+  const size_t max_writers =
+      std::max(4u, std::thread::hardware_concurrency());
+  for (size_t writers = 1; writers <= max_writers; writers *= 2) {
+    BENCHMARK_ADVANCED("insert with " + std::to_string(writers) + " writers")(
+        Catch::Benchmark::Chronometer meter) {
+      meter.measure([&] {
+        yaldb::SkipList<size_t> skip_list;
+        std::vector<std::thread> threads;
+        for (size_t w = 0; w < writers; ++w) {
+          threads.emplace_back([&, w] {
+            for (size_t i = w; i < kLength; i += writers) {
+              skip_list.InsertConcurrently(keys[i]);
+            }
+          });
+        }
+        for (auto &thread : threads) thread.join();
+        return skip_list.Size();
+      });
+    };
+  }
+}
+
+TEST_CASE("bulk loading of SkipList", "[SkipList]") {
+  constexpr size_t kLength = 10000;
+  std::vector<size_t> sorted(kLength);
+  for (size_t i = 0; i < kLength; ++i) {
+    sorted[i] = i / 3;
+  }
+  SECTION("build from sorted range") {
+    yaldb::SkipList<size_t> skip_list(sorted.begin(), sorted.end());
+    REQUIRE(skip_list.Size() == kLength);
+    REQUIRE(std::equal(skip_list.begin(), skip_list.end(),
+                       sorted.begin(), sorted.end()));
+    auto it = skip_list.end();
+    for (auto rit = sorted.rbegin(); rit != sorted.rend(); ++rit) {
+      REQUIRE(*--it == *rit);
+    }
+    for (size_t i = 0; i < kLength / 3; ++i) {
+      auto[first, last] = skip_list.EqualRange(i);
+      REQUIRE(std::distance(first, last) == 3);
+    }
+    // the built list keeps working as an ordinary one
+    skip_list.Insert(kLength);
+    skip_list.Insert(0);
+    REQUIRE(skip_list.Erase(1) != skip_list.end());
+    REQUIRE(skip_list.Size() == kLength - 1);
+    REQUIRE(*skip_list.begin() == 0);
+    REQUIRE(*--skip_list.end() == kLength);
+  }
+  SECTION("empty range") {
+    std::vector<size_t> empty;
+    yaldb::SkipList<size_t> skip_list(empty.begin(), empty.end());
+    REQUIRE(skip_list.Empty());
+    REQUIRE(skip_list.begin() == skip_list.end());
+  }
+  SECTION("batch insertion") {
+    yaldb::SkipList<size_t> skip_list;
+    for (size_t i = 0; i < kLength; i += 2) {
+      skip_list.Insert(i);
+    }
+    // sorted, then descending and finally unordered batches
+    std::vector<size_t> batch;
+    for (size_t i = 1; i < kLength; i += 2) {
+      batch.push_back(i);
+    }
+    skip_list.InsertBatch(batch.begin(), batch.end());
+    skip_list.InsertBatch(batch.rbegin(), batch.rend());
+    std::shuffle(batch.begin(), batch.end(), std::mt19937(5));
+    skip_list.InsertBatch(batch.begin(), batch.end());
+
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < kLength; ++i) {
+      expected.insert(expected.end(), i % 2 == 0 ? 1 : 3, i);
+    }
+    REQUIRE(skip_list.Size() == expected.size());
+    REQUIRE(std::equal(skip_list.begin(), skip_list.end(),
+                       expected.begin(), expected.end()));
+    for (size_t i = 1; i < kLength; i += 2) {
+      auto[first, last] = skip_list.EqualRange(i);
+      REQUIRE(std::distance(first, last) == 3);
+    }
+  }
+}
+
+TEST_CASE("order of equal elements of SkipList", "[SkipList]") {
+  // ordered by key only, told apart by tag
+  using Element = std::pair<int, char>;
+  struct KeyLess {
+    bool operator()(const Element &lhs, const Element &rhs) const {
+      return lhs.first < rhs.first;
+    }
+  };
+  // every insertion links in front of the elements equal to it, whether
+  // alone, hinted or batched, sorted or not
+  yaldb::SkipList<Element, KeyLess> skip_list;
+  skip_list.Insert({1, 'a'});
+  skip_list.Insert({2, 'a'});
+  const std::vector<Element> batch = {{1, 'b'}, {1, 'c'}, {2, 'b'}};
+  skip_list.InsertBatch(batch.begin(), batch.end());
+  skip_list.Insert(skip_list.end(), {1, 'd'});
+  skip_list.Insert({2, 'c'});
+  const std::vector<Element> unsorted = {{2, 'd'}, {1, 'e'}, {2, 'e'}};
+  skip_list.InsertBatch(unsorted.begin(), unsorted.end());
+  const std::vector<Element> expected = {
+      {1, 'e'}, {1, 'd'}, {1, 'c'}, {1, 'b'}, {1, 'a'},
+      {2, 'e'}, {2, 'd'}, {2, 'c'}, {2, 'b'}, {2, 'a'}};
+  REQUIRE(std::equal(skip_list.begin(), skip_list.end(),
+                     expected.begin(), expected.end()));
+  // a built list keeps the order of its range instead
+  yaldb::SkipList<Element, KeyLess> built(batch.begin(), batch.end());
+  REQUIRE(std::equal(built.begin(), built.end(), batch.begin(), batch.end()));
+}
+
+TEST_CASE("hinted insertion and lookup of SkipList", "[SkipList]") {
+  constexpr size_t kLength = 10000;
+  std::mt19937 rand_gen(7);
+  std::vector<size_t> expected;
+  yaldb::SkipList<size_t> skip_list;
+  SECTION("ascending keys hinted with end") {
+    for (size_t i = 0; i < kLength; ++i) {
+      skip_list.Insert(skip_list.end(), i / 2);
+      expected.push_back(i / 2);
+    }
+  }
+  SECTION("keys near the previous insertion") {
+    auto hint = skip_list.end();
+    for (size_t i = 0; i < kLength; ++i) {
+      size_t key = i + rand_gen() % 16;
+      hint = skip_list.Insert(hint, key);
+      REQUIRE(*hint == key);
+      expected.push_back(key);
+    }
+  }
+  SECTION("hints far from the keys") {
+    for (size_t i = 0; i < kLength; ++i) {
+      size_t key = rand_gen() % kLength;
+      auto hint = skip_list.Find(rand_gen() % kLength);
+      skip_list.Insert(rand_gen() % 2 ? hint : skip_list.begin(), key);
+      expected.push_back(key);
+    }
+  }
+  std::sort(expected.begin(), expected.end());
+  REQUIRE(skip_list.Size() == expected.size());
+  REQUIRE(std::equal(skip_list.begin(), skip_list.end(),
+                     expected.begin(), expected.end()));
+  auto it = skip_list.end();
+  for (auto rit = expected.rbegin(); rit != expected.rend(); ++rit) {
+    REQUIRE(*--it == *rit);
+  }
+  // lookups hinted by the previous result, by unrelated nodes and by end
+  auto hint = skip_list.begin();
+  for (size_t key : expected) {
+    hint = skip_list.Find(hint, key);
+    REQUIRE(hint != skip_list.end());
+    REQUIRE(*hint == key);
+    REQUIRE(skip_list.Find(skip_list.end(), key) != skip_list.end());
+    auto far = skip_list.Find(expected[rand_gen() % expected.size()]);
+    REQUIRE(*skip_list.Find(far, key) == key);
+  }
+  REQUIRE(skip_list.Find(skip_list.begin(), kLength * 2) == skip_list.end());
+  REQUIRE(skip_list.Find(hint, kLength * 2) == skip_list.end());
+}
+
+TEST_CASE("hinted insertion and lookup benchmark of SkipList",
+          "[SkipList][!benchmark]") {
+  constexpr size_t kLength = 100000;
+  std::mt19937 rand_gen(11);
+  std::vector<size_t> sequential(kLength), near_sequential(kLength);
+  std::iota(sequential.begin(), sequential.end(), 0);
+  for (size_t i = 0; i < kLength; ++i) {
+    near_sequential[i] = i * 4 + rand_gen() % 16;
+  }
+  for (auto *keys : {&sequential, &near_sequential}) {
+    std::string name = keys == &sequential ? "sequential" : "near sequential";
+    BENCHMARK_ADVANCED("insert " + name)(Catch::Benchmark::Chronometer meter) {
+      meter.measure([&] {
+        yaldb::SkipList<size_t> skip_list;
+        for (size_t key : *keys) {
+          skip_list.Insert(key);
+        }
+        return skip_list.Size();
+      });
+    };
+    BENCHMARK_ADVANCED("hinted insert " + name)(
+        Catch::Benchmark::Chronometer meter) {
+      meter.measure([&] {
+        yaldb::SkipList<size_t> skip_list;
+        auto hint = skip_list.end();
+        for (size_t key : *keys) {
+          hint = skip_list.Insert(hint, key);
+        }
+        return skip_list.Size();
+      });
+    };
+    yaldb::SkipList<size_t> skip_list(sequential.begin(), sequential.end());
+    BENCHMARK("find " + name) {
+      size_t found = 0;
+      for (size_t key : *keys) {
+        found += skip_list.Find(key) != skip_list.end();
+      }
+      return found;
+    };
+    BENCHMARK("hinted find " + name) {
+      size_t found = 0;
+      auto hint = skip_list.begin();
+      for (size_t key : *keys) {
+        auto it = skip_list.Find(hint, key);
+        if (it != skip_list.end()) {
+          hint = it;
+          ++found;
+        }
+      }
+      return found;
+    };
+  }
+}
+
+TEST_CASE("bounds and range scans of SkipList", "[SkipList]") {
+  constexpr size_t kLength = 3000;
+  // every even key three times
+  std::vector<size_t> expected;
+  yaldb::SkipList<size_t> skip_list;
+  for (size_t i = 0; i < kLength; i += 2) {
+    for (size_t j = 0; j < 3; ++j) {
+      skip_list.Insert(i);
+      expected.push_back(i);
+    }
+  }
+  for (size_t i = 0; i <= kLength; ++i) {
+    auto lower = std::lower_bound(expected.begin(), expected.end(), i);
+    auto upper = std::upper_bound(expected.begin(), expected.end(), i);
+    REQUIRE(std::distance(skip_list.begin(), skip_list.LowerBound(i)) ==
+        lower - expected.begin());
+    REQUIRE(std::distance(skip_list.begin(), skip_list.UpperBound(i)) ==
+        upper - expected.begin());
+  }
+  for (size_t distance : {0, 1, 4, 16}) {
+    yaldb::SkipList<size_t>::ScanIterator it(&skip_list, distance);
+    REQUIRE_FALSE(it.Valid());
+    it.SeekToFirst();
+    for (size_t key : expected) {
+      REQUIRE(it.Valid());
+      REQUIRE(it.value() == key);
+      it.Next();
+    }
+    REQUIRE_FALSE(it.Valid());
+    it.SeekToLast();
+    for (auto rit = expected.rbegin(); rit != expected.rend(); ++rit) {
+      REQUIRE(it.Valid());
+      REQUIRE(it.value() == *rit);
+      it.Prev();
+    }
+    REQUIRE_FALSE(it.Valid());
+
+    it.Seek(7);
+    REQUIRE(it.value() == 8);
+    it.Seek(8);
+    REQUIRE(it.value() == 8);
+    it.Prev();
+    REQUIRE(it.value() == 6);
+    it.Next();
+    REQUIRE(it.value() == 8);
+    it.SeekForPrev(7);
+    REQUIRE(it.value() == 6);
+    it.Next();
+    it.Next();
+    it.Next();
+    REQUIRE(it.value() == 8);
+    it.SeekForPrev(8);
+    REQUIRE(it.value() == 8);
+    it.Next();
+    REQUIRE(it.value() == 10);
+    // a range scan over [100, 200)
+    size_t count = 0;
+    for (it.Seek(100); it.Valid() && it.value() < 200; it.Next()) {
+      ++count;
+    }
+    REQUIRE(count == 150);
+    it.Seek(kLength);
+    REQUIRE_FALSE(it.Valid());
+    it.SeekForPrev(1);
+    for (size_t j = 0; j < 3; ++j) {
+      REQUIRE(it.value() == 0);
+      it.Prev();
+    }
+    REQUIRE_FALSE(it.Valid());
+  }
+  yaldb::SkipList<size_t> empty;
+  yaldb::SkipList<size_t>::ScanIterator it(&empty);
+  it.SeekToFirst();
+  REQUIRE_FALSE(it.Valid());
+  it.SeekToLast();
+  REQUIRE_FALSE(it.Valid());
+  it.SeekForPrev(1);
+  REQUIRE_FALSE(it.Valid());
+}
+
+TEST_CASE("range scan benchmark of SkipList", "[SkipList][!benchmark]") {
+  constexpr size_t kLength = 1 << 20;
+  // insert in random order so that neighbours are scattered in the arena
+  std::vector<size_t> keys(kLength);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(13));
+  yaldb::SkipList<size_t> skip_list;
+  for (size_t key : keys) {
+    skip_list.Insert(key);
+  }
+  // prefetching overlaps a miss with the work on earlier elements, so each
+  // element gets a little work like decoding or filtering in a real scan
+  for (size_t distance : {0, 2, 4, 8, 16}) {
+    BENCHMARK("scan with prefetch distance " + std::to_string(distance)) {
+      yaldb::SkipList<size_t>::ScanIterator it(&skip_list, distance);
+      size_t sum = 0;
+      for (it.Seek(kLength / 4); it.Valid(); it.Next()) {
+        size_t hash = it.value();
+        for (size_t i = 0; i < 32; ++i) {
+          hash = (hash ^ (hash >> 29)) * 0x9e3779b97f4a7c15;
+        }
+        sum += hash;
+      }
+      return sum;
+    };
+  }
+}
+
+TEST_CASE("batched lookup of SkipList", "[SkipList]") {
+  constexpr size_t kLength = 20000;
+  std::mt19937 rand_gen(14);
+  yaldb::SkipList<size_t> skip_list;
+  // even keys only, with some of them duplicated
+  for (size_t i = 0; i < kLength; ++i) {
+    skip_list.Insert(rand_gen() % kLength * 2);
+  }
+  for (size_t i = 0; i < kLength; i += 3) {
+    skip_list.Erase(i * 2);
+  }
+  // batch sizes around the group size, including the empty batch
+  for (size_t n : {0, 1, 15, 16, 17, 100, 1000}) {
+    std::vector<size_t> keys(n);
+    for (auto &key : keys) {
+      key = rand_gen() % (kLength * 2 + 2);
+    }
+    std::vector<yaldb::SkipList<size_t>::iterator> result(n);
+    skip_list.MultiFind(keys.data(), n, result.data());
+    for (size_t i = 0; i < n; ++i) {
+      REQUIRE(result[i] == skip_list.Find(keys[i]));
+    }
+  }
+  yaldb::SkipList<size_t> empty;
+  size_t key = 0;
+  yaldb::SkipList<size_t>::iterator it;
+  empty.MultiFind(&key, 1, &it);
+  REQUIRE(it == empty.end());
+}
+
+TEST_CASE("batched lookup benchmark of SkipList", "[SkipList][!benchmark]") {
+  constexpr size_t kLength = 1 << 20, kBatch = 256, kLookups = 1 << 16;
+  std::mt19937 rand_gen(15);
+  std::vector<size_t> keys(kLength);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), rand_gen);
+  yaldb::SkipList<size_t> skip_list;
+  for (size_t key : keys) {
+    skip_list.Insert(key);
+  }
+  std::shuffle(keys.begin(), keys.end(), rand_gen);
+  keys.resize(kLookups);
+  std::vector<yaldb::SkipList<size_t>::iterator> result(kBatch);
+  BENCHMARK("find one by one") {
+    size_t found = 0;
+    for (size_t key : keys) {
+      found += skip_list.Find(key) != skip_list.end();
+    }
+    return found;
+  };
+  BENCHMARK("find in batches of " + std::to_string(kBatch)) {
+    size_t found = 0;
+    for (size_t i = 0; i < kLookups; i += kBatch) {
+      skip_list.MultiFind(keys.data() + i, kBatch, result.data());
+      for (auto it : result) {
+        found += it != skip_list.end();
+      }
+    }
+    return found;
+  };
+}
+
+TEST_CASE("splitting and joining of SkipList", "[SkipList]") {
+  constexpr size_t kLength = 10000;
+  std::mt19937 rand_gen(19);
+  auto skip_list = std::make_unique<yaldb::SkipList<std::string>>();
+  std::multiset<std::string> expected;
+  auto key_of = [](size_t i) {
+    // long enough to live on the heap, and ordered like i
+    return std::string(32, '-') + std::to_string(100000 + i);
+  };
+  for (size_t i = 0; i < kLength; ++i) {
+    std::string key = key_of(rand_gen() % (kLength / 2));
+    skip_list->Insert(key);
+    expected.insert(key);
+  }
+  auto require_same = [](const yaldb::SkipList<std::string> &list,
+                         auto first, auto last) {
+    REQUIRE(list.Size() == static_cast<size_t>(std::distance(first, last)));
+    REQUIRE(std::equal(list.begin(), list.end(), first, last));
+    auto it = list.end();
+    for (auto rit = std::make_reverse_iterator(last);
+         rit != std::make_reverse_iterator(first); ++rit) {
+      REQUIRE(*--it == *rit);
+    }
+    REQUIRE(it == list.begin());
+  };
+
+  // split at existing keys, missing keys and both ends
+  for (size_t i : {size_t(0), kLength / 8, kLength / 3, kLength / 2}) {
+    const std::string key = key_of(i);
+    auto upper = skip_list->Split(key);
+    auto middle = expected.lower_bound(key);
+    require_same(*skip_list, expected.begin(), middle);
+    require_same(*upper, middle, expected.end());
+    for (size_t j = 0; j < kLength / 2; j += 97) {
+      const std::string probe = key_of(j);
+      const bool present = expected.count(probe) != 0;
+      REQUIRE((skip_list->Find(probe) != skip_list->end()) ==
+          (present && probe < key));
+      REQUIRE((upper->Find(probe) != upper->end()) ==
+          (present && !(probe < key)));
+    }
+    // both halves keep working on their own
+    upper->Erase(upper->Insert(key));
+    skip_list->Erase(skip_list->Insert(key_of(0)));
+
+    skip_list->Join(upper.get());
+    REQUIRE(upper->Empty());
+    REQUIRE(upper->begin() == upper->end());
+    require_same(*skip_list, expected.begin(), expected.end());
+    // upper is left empty but usable
+    upper->Insert(key);
+    REQUIRE(upper->Size() == 1);
+  }
+
+  // the split part outlives the list it came from
+  auto upper = skip_list->Split(key_of(kLength / 4));
+  skip_list.reset();
+  require_same(*upper, expected.lower_bound(key_of(kLength / 4)),
+               expected.end());
+}
+
+namespace {
+
+using Named = std::pair<std::string, size_t>;
+
+// orders by name and probes with a plain view of it
+struct NameLess {
+  using is_transparent = void;
+
+  bool operator()(const Named &lhs, const Named &rhs) const {
+    return lhs.first < rhs.first;
+  }
+  bool operator()(const Named &lhs, std::string_view rhs) const {
+    return lhs.first < rhs;
+  }
+  bool operator()(std::string_view lhs, const Named &rhs) const {
+    return lhs < rhs.first;
+  }
+};
+
+}  // namespace
+
+TEST_CASE("heterogeneous lookup of SkipList", "[SkipList]") {
+  constexpr size_t kLength = 2000;
+  yaldb::SkipList<Named, NameLess> skip_list;
+  std::multiset<Named, NameLess> expected;
+  auto name_of = [](size_t i) { return "name-" + std::to_string(i); };
+  for (size_t i = 0; i < kLength; ++i) {
+    Named named(name_of(i % (kLength / 2)), i);
+    skip_list.Insert(named);
+    expected.insert(named);
+  }
+  for (size_t i = 0; i < kLength; i += 3) {
+    const std::string name = name_of(i);
+    const std::string_view key = name;
+    auto it = skip_list.Find(key);
+    REQUIRE((it == skip_list.end()) == (expected.count(key) == 0));
+    if (it != skip_list.end()) {
+      REQUIRE(it->first == key);
+    }
+    REQUIRE(std::distance(skip_list.begin(), skip_list.LowerBound(key)) ==
+        std::distance(expected.begin(), expected.lower_bound(key)));
+    REQUIRE(std::distance(skip_list.begin(), skip_list.UpperBound(key)) ==
+        std::distance(expected.begin(), expected.upper_bound(key)));
+    auto [first, last] = skip_list.EqualRange(key);
+    REQUIRE(static_cast<size_t>(std::distance(first, last)) ==
+        expected.count(key));
+  }
+  for (size_t i = 0; i < kLength / 2; i += 2) {
+    const std::string name = name_of(i);
+    REQUIRE(skip_list.Erase(std::string_view(name)) != skip_list.end());
+    expected.erase(expected.lower_bound(std::string_view(name)),
+                   expected.upper_bound(std::string_view(name)));
+  }
+  // equal names may come in another order than in the multiset
+  REQUIRE(std::equal(skip_list.begin(), skip_list.end(),
+                     expected.begin(), expected.end(),
+                     [](const Named &lhs, const Named &rhs) {
+                       return lhs.first == rhs.first;
+                     }));
+
+  // std::less<> compares strings with string literals in place
+  yaldb::SkipList<std::string, std::less<>> names;
+  names.Insert("alpha");
+  names.Insert("beta");
+  REQUIRE(*names.Find("beta") == "beta");
+  REQUIRE(names.Find("gamma") == names.end());
+  REQUIRE(*names.LowerBound("b") == "beta");
+}
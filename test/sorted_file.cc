@@ -0,0 +1,196 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/sorted_file.h"
+
+#include <catch2/catch.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "yaldb/skip_list.h"
+
+namespace {
+
+// removes the file when the test is done with it
+class TempFile {
+ public:
+  explicit TempFile(const std::string &name) :
+      path_((std::filesystem::temp_directory_path() /
+          (name + "." + std::to_string(::getpid()))).string()) {}
+  ~TempFile() { std::remove(path_.c_str()); }
+
+  const std::string &path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+struct Record {
+  uint64_t key;
+  uint32_t payload[6];
+};
+
+struct RecordLess {
+  bool operator()(const Record &lhs, const Record &rhs) const {
+    return lhs.key < rhs.key;
+  }
+};
+
+struct RecordHash {
+  size_t operator()(const Record &record) const { return record.key; }
+};
+
+}  // namespace
+
+TEST_CASE("writing and mapping a SortedFile", "[SortedFile]") {
+  constexpr size_t kLength = 20000;
+  std::mt19937 rand_gen(20);
+  TempFile file("yaldb_sorted_file");
+  yaldb::SkipList<uint64_t> skip_list;
+  for (size_t i = 0; i < kLength; ++i) {
+    // even keys, some of them repeated
+    skip_list.Insert(rand_gen() % kLength * 2);
+  }
+  // small blocks so that the index has many entries
+  for (size_t bits_per_key : {0, 10}) {
+    yaldb::SortedFileWriter<uint64_t> writer(256, bits_per_key);
+    REQUIRE(writer.Open(file.path()));
+    REQUIRE(writer.Add(skip_list.begin(), skip_list.end()));
+    REQUIRE(writer.Finish());
+
+    yaldb::SortedFile<uint64_t> sorted_file;
+    REQUIRE(sorted_file.Open(file.path()));
+    REQUIRE(sorted_file.Size() == skip_list.Size());
+    REQUIRE(std::equal(sorted_file.begin(), sorted_file.end(),
+                       skip_list.begin(), skip_list.end()));
+    size_t absent = 0, false_positives = 0;
+    for (uint64_t key = 0; key <= kLength * 2 + 1; ++key) {
+      auto [first, last] = sorted_file.EqualRange(key);
+      REQUIRE(first == sorted_file.LowerBound(key));
+      REQUIRE(last == sorted_file.UpperBound(key));
+      REQUIRE(first - sorted_file.begin() ==
+          std::distance(skip_list.begin(), skip_list.LowerBound(key)));
+      REQUIRE(last - sorted_file.begin() ==
+          std::distance(skip_list.begin(), skip_list.UpperBound(key)));
+      const bool present = skip_list.Find(key) != skip_list.end();
+      REQUIRE((sorted_file.Find(key) != sorted_file.end()) == present);
+      if (present) {
+        REQUIRE(sorted_file.MayContain(key));
+        REQUIRE(sorted_file.Find(key) == first);
+      } else {
+        ++absent;
+        false_positives += sorted_file.MayContain(key);
+      }
+    }
+    if (bits_per_key == 0) {
+      REQUIRE(false_positives == absent);
+    } else {
+      // about 1% is expected at 10 bits per key
+      REQUIRE(false_positives < absent / 25);
+    }
+  }
+}
+
+TEST_CASE("records of a SortedFile are used in place", "[SortedFile]") {
+  constexpr size_t kLength = 1000;
+  TempFile file("yaldb_sorted_file_records");
+  std::vector<Record> records(kLength);
+  for (size_t i = 0; i < kLength; ++i) {
+    records[i].key = i * 3;
+    std::fill(std::begin(records[i].payload), std::end(records[i].payload),
+              static_cast<uint32_t>(i));
+  }
+  yaldb::SortedFileWriter<Record, RecordLess, RecordHash> writer;
+  REQUIRE(writer.Open(file.path()));
+  REQUIRE(writer.Add(records.begin(), records.end()));
+  REQUIRE(writer.Finish());
+
+  yaldb::SortedFile<Record, RecordLess, RecordHash> sorted_file;
+  REQUIRE(sorted_file.Open(file.path()));
+  for (size_t i = 0; i < kLength; ++i) {
+    const Record *record = sorted_file.Find(Record{i * 3, {}});
+    REQUIRE(record == sorted_file.begin() + i);
+    REQUIRE(record->payload[5] == i);
+    REQUIRE(sorted_file.Find(Record{i * 3 + 1, {}}) == sorted_file.end());
+  }
+  // a file of another record type is rejected
+  yaldb::SortedFile<uint64_t> other;
+  REQUIRE_FALSE(other.Open(file.path()));
+  REQUIRE(other.Empty());
+}
+
+TEST_CASE("empty and invalid SortedFiles", "[SortedFile]") {
+  TempFile file("yaldb_sorted_file_empty");
+  yaldb::SortedFile<uint64_t> sorted_file;
+  REQUIRE_FALSE(sorted_file.Open(file.path()));
+
+  yaldb::SortedFileWriter<uint64_t> writer;
+  REQUIRE(writer.Open(file.path()));
+  REQUIRE(writer.Finish());
+  REQUIRE(sorted_file.Open(file.path()));
+  REQUIRE(sorted_file.Empty());
+  REQUIRE(sorted_file.begin() == sorted_file.end());
+  REQUIRE(sorted_file.Find(1) == sorted_file.end());
+  REQUIRE(sorted_file.LowerBound(1) == sorted_file.end());
+
+  // a truncated file
+  REQUIRE(writer.Open(file.path()));
+  for (uint64_t key = 0; key < 100; ++key) {
+    REQUIRE(writer.Add(key));
+  }
+  REQUIRE(writer.Finish());
+  // a finished writer fails until it is opened again
+  REQUIRE_FALSE(writer.Add(100));
+  REQUIRE_FALSE(writer.Finish());
+  std::filesystem::resize_file(file.path(),
+                               std::filesystem::file_size(file.path()) - 8);
+  REQUIRE_FALSE(sorted_file.Open(file.path()));
+  REQUIRE(sorted_file.Empty());
+
+  REQUIRE_FALSE(writer.Open("/nonexistent/yaldb_sorted_file"));
+  REQUIRE_FALSE(writer.Add(1));
+  REQUIRE_FALSE(writer.Finish());
+}
+
+TEST_CASE("restart benchmark of SortedFile", "[SortedFile][!benchmark]") {
+  constexpr size_t kLength = 1 << 20, kLookups = 1 << 10;
+  std::mt19937 rand_gen(21);
+  std::vector<uint64_t> keys(kLength);
+  for (auto &key : keys) {
+    key = rand_gen();
+  }
+  std::vector<uint64_t> lookups(keys.begin(), keys.begin() + kLookups);
+  std::sort(keys.begin(), keys.end());
+  TempFile file("yaldb_sorted_file_restart");
+  yaldb::SortedFileWriter<uint64_t> writer;
+  REQUIRE(writer.Open(file.path()));
+  REQUIRE(writer.Add(keys.begin(), keys.end()));
+  REQUIRE(writer.Finish());
+  // both start from the persisted keys and answer a few lookups
+  BENCHMARK("bulk build SkipList") {
+    yaldb::SkipList<uint64_t> skip_list(keys.begin(), keys.end());
+    size_t found = 0;
+    for (uint64_t key : lookups) {
+      found += skip_list.Find(key) != skip_list.end();
+    }
+    return found;
+  };
+  BENCHMARK("map SortedFile") {
+    yaldb::SortedFile<uint64_t> sorted_file;
+    sorted_file.Open(file.path());
+    size_t found = 0;
+    for (uint64_t key : lookups) {
+      found += sorted_file.Find(key) != sorted_file.end();
+    }
+    return found;
+  };
+}
@@ -0,0 +1,86 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/timing_wheel.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Timer : yaldb::impl::TimerNode {
+  // tick it fired at, 0 if not yet
+  uint64_t fired = 0;
+};
+
+}  // namespace
+
+TEST_CASE("timers of timing wheel fire on their deadlines", "[TimingWheel]") {
+  constexpr size_t kTimers = 5000;
+  std::mt19937_64 rng(42);
+  yaldb::impl::TimingWheel wheel(1000);
+  std::vector<Timer> timers(kTimers);
+  // deadlines of every level, some due already, some beyond the top level
+  for (size_t i = 0; i < kTimers; ++i) {
+    const int bits = static_cast<int>(rng() % 40);
+    const uint64_t deadline = i % 100 == 0 ? 0 : 1000 + rng() % (1ull << bits);
+    wheel.Schedule(&timers[i], deadline);
+  }
+  REQUIRE(kTimers == wheel.size());
+  // steps of a tick, a slot, or far ahead
+  constexpr uint64_t kSteps[] = {1, 64, 4096, 1ull << 30};
+  uint64_t now = wheel.now();
+  while (!wheel.empty()) {
+    const uint64_t last = now;
+    now += rng() % kSteps[rng() % 4] + 1;
+    wheel.Advance(now, [now, last](yaldb::impl::TimerNode *node) {
+      auto *timer = static_cast<Timer *>(node);
+      REQUIRE(!timer->scheduled());
+      REQUIRE(timer->deadline <= now);
+      // due ones at the first tick after their scheduling
+      REQUIRE(std::max<uint64_t>(timer->deadline, 1001) > last);
+      timer->fired = now;
+    });
+    REQUIRE(now == wheel.now());
+  }
+  for (const Timer &timer : timers) {
+    REQUIRE(timer.fired != 0);
+  }
+}
+
+TEST_CASE("cancelled timers of timing wheel never fire", "[TimingWheel]") {
+  yaldb::impl::TimingWheel wheel(0);
+  std::vector<Timer> timers(200);
+  for (size_t i = 0; i < timers.size(); ++i) {
+    wheel.Schedule(&timers[i], i * 50);
+  }
+  for (size_t i = 0; i < timers.size(); i += 2) {
+    wheel.Cancel(&timers[i]);
+    wheel.Cancel(&timers[i]);
+  }
+  REQUIRE(100 == wheel.size());
+  // every firing cancels the next timer left
+  size_t fired = 0;
+  wheel.Advance(100000, [&](yaldb::impl::TimerNode *node) {
+    auto *timer = static_cast<Timer *>(node);
+    const size_t i = timer - timers.data();
+    REQUIRE(i % 2 == 1);
+    if (i + 2 < timers.size()) wheel.Cancel(&timers[i + 2]);
+    ++fired;
+  });
+  REQUIRE(wheel.empty());
+  REQUIRE(50 == fired);
+  // timers due already fire at the next tick
+  Timer due;
+  wheel.Schedule(&due, 1);
+  wheel.Advance(100000, [](yaldb::impl::TimerNode *) { FAIL(); });
+  wheel.Advance(100001, [&due](yaldb::impl::TimerNode *node) {
+    REQUIRE(&due == node);
+  });
+  REQUIRE(wheel.empty());
+}
@@ -0,0 +1,306 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/unrolled_skip_list.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "yaldb/skip_list.h"
+
+namespace {
+
+template<typename T, typename Set>
+void RequireSameElements(const yaldb::UnrolledSkipList<T> &list,
+                         const Set &expected) {
+  REQUIRE(list.Size() == expected.size());
+  REQUIRE(std::equal(list.begin(), list.end(),
+                     expected.begin(), expected.end()));
+  auto it = list.end();
+  for (auto rit = expected.rbegin(); rit != expected.rend(); ++rit) {
+    REQUIRE(*--it == *rit);
+  }
+  REQUIRE(it == list.begin());
+}
+
+// counts the bytes a container holds through its allocator
+template<typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  explicit CountingAllocator(size_t *bytes) : bytes(bytes) {}
+  template<typename U>
+  CountingAllocator(const CountingAllocator<U> &alloc)  // NOLINT
+      : bytes(alloc.bytes) {}
+  T *allocate(size_t n) {
+    *bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *p, size_t n) {
+    *bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+  bool operator==(const CountingAllocator &alloc) const {
+    return bytes == alloc.bytes;
+  }
+  bool operator!=(const CountingAllocator &alloc) const {
+    return bytes != alloc.bytes;
+  }
+
+  size_t *bytes;
+};
+
+}  // namespace
+
+TEST_CASE("insertion and erasure of UnrolledSkipList", "[UnrolledSkipList]") {
+  constexpr size_t kLength = 20000;
+  std::mt19937 rand_gen(3);
+  yaldb::UnrolledSkipList<size_t> list;
+  std::multiset<size_t> expected;
+  SECTION("ascending") {
+    for (size_t i = 0; i < kLength; ++i) {
+      REQUIRE(*list.Insert(i / 4) == i / 4);
+      expected.insert(i / 4);
+    }
+  }
+  SECTION("descending") {
+    for (size_t i = kLength; i > 0; --i) {
+      REQUIRE(*list.Insert(i / 4) == i / 4);
+      expected.insert(i / 4);
+    }
+  }
+  SECTION("random") {
+    for (size_t i = 0; i < kLength; ++i) {
+      size_t key = rand_gen() % (kLength / 4);
+      REQUIRE(*list.Insert(key) == key);
+      expected.insert(key);
+    }
+  }
+  RequireSameElements(list, expected);
+  for (size_t i = 0; i <= kLength / 4; ++i) {
+    auto[first, last] = list.EqualRange(i);
+    REQUIRE(static_cast<size_t>(std::distance(first, last)) ==
+        expected.count(i));
+    REQUIRE(std::distance(list.begin(), list.LowerBound(i)) ==
+        std::distance(expected.begin(), expected.lower_bound(i)));
+    REQUIRE(std::distance(list.begin(), list.UpperBound(i)) ==
+        std::distance(expected.begin(), expected.upper_bound(i)));
+    auto it = list.Find(i);
+    if (expected.count(i) == 0) {
+      REQUIRE(it == list.end());
+    } else {
+      REQUIRE(*it == i);
+    }
+  }
+
+  // erase every value in random order, alternating both overloads
+  std::vector<size_t> keys(expected.begin(), expected.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  std::shuffle(keys.begin(), keys.end(), rand_gen);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const size_t key = keys[i];
+    if (i % 2 == 0) {
+      auto it = list.Erase(key);
+      REQUIRE(it != list.end());
+      auto prev = expected.lower_bound(key);
+      if (prev == expected.begin()) {
+        REQUIRE(++it == list.begin());
+      } else {
+        REQUIRE(*it == *--prev);
+      }
+      expected.erase(key);
+    } else {
+      auto it = list.Find(key);
+      REQUIRE(it != list.end());
+      list.Erase(it);
+      expected.erase(expected.find(key));
+    }
+    REQUIRE(list.Erase(kLength) == list.end());
+    if (i % 256 == 0) {
+      RequireSameElements(list, expected);
+    }
+  }
+  RequireSameElements(list, expected);
+  while (!expected.empty()) {
+    list.Erase(list.begin());
+    expected.erase(expected.begin());
+  }
+  REQUIRE(list.Empty());
+  REQUIRE(list.begin() == list.end());
+  REQUIRE(list.Erase(list.begin()) == list.end());
+}
+
+TEST_CASE("non-trivial values of UnrolledSkipList", "[UnrolledSkipList]") {
+  constexpr size_t kLength = 5000;
+  std::mt19937 rand_gen(4);
+  yaldb::UnrolledSkipList<std::string> list;
+  std::multiset<std::string> expected;
+  for (size_t i = 0; i < kLength; ++i) {
+    // long enough to live on the heap
+    std::string key = std::to_string(rand_gen() % 1000) + std::string(32, '-');
+    list.Insert(key);
+    expected.insert(key);
+  }
+  RequireSameElements(list, expected);
+  for (size_t i = 0; i < 1000; i += 3) {
+    std::string key = std::to_string(i) + std::string(32, '-');
+    list.Erase(key);
+    expected.erase(key);
+  }
+  RequireSameElements(list, expected);
+}
+
+TEST_CASE("memory and lookup benchmark of UnrolledSkipList",
+          "[UnrolledSkipList][!benchmark]") {
+  constexpr size_t kLength = 1 << 20, kLookups = 1 << 16;
+  std::mt19937 rand_gen(5);
+  std::vector<size_t> keys(kLength);
+  for (auto &key : keys) {
+    key = rand_gen();
+  }
+  yaldb::UnrolledSkipList<size_t> unrolled;
+  yaldb::SkipList<size_t> skip_list;
+  size_t multiset_bytes = 0;
+  std::multiset<size_t, std::less<>, CountingAllocator<size_t>> multiset{
+      CountingAllocator<size_t>(&multiset_bytes)};
+  for (size_t key : keys) {
+    unrolled.Insert(key);
+    skip_list.Insert(key);
+    multiset.insert(key);
+  }
+  std::printf("bytes per key: UnrolledSkipList %.1f, SkipList %.1f, "
+              "std::multiset %.1f\n",
+              static_cast<double>(unrolled.MemoryUsage()) / kLength,
+              static_cast<double>(skip_list.MemoryUsage()) / kLength,
+              static_cast<double>(multiset_bytes) / kLength);
+
+  std::shuffle(keys.begin(), keys.end(), rand_gen);
+  keys.resize(kLookups);
+  BENCHMARK("find UnrolledSkipList") {
+    size_t found = 0;
+    for (size_t key : keys) {
+      found += unrolled.Find(key) != unrolled.end();
+    }
+    return found;
+  };
+  BENCHMARK("find SkipList") {
+    size_t found = 0;
+    for (size_t key : keys) {
+      found += skip_list.Find(key) != skip_list.end();
+    }
+    return found;
+  };
+  BENCHMARK("find std::multiset") {
+    size_t found = 0;
+    for (size_t key : keys) {
+      found += multiset.find(key) != multiset.end();
+    }
+    return found;
+  };
+}
+
+namespace {
+
+// same order as std::less, but hides it from the SIMD search
+struct PlainLess {
+  template<typename T>
+  bool operator()(const T &lhs, const T &rhs) const { return lhs < rhs; }
+};
+
+template<typename T, typename Comp>
+void RequireBoundsOfIntegers() {
+  static_assert(yaldb::impl::IsSimdSearchable<T, Comp>::value);
+  std::mt19937_64 rand_gen(6);
+  yaldb::UnrolledSkipList<T, Comp> list;
+  std::multiset<T> expected;
+  // few distinct keys around zero and the extremes of T
+  std::vector<T> keys{std::numeric_limits<T>::min(),
+                      std::numeric_limits<T>::max(), T(0), T(1), T(-1)};
+  for (size_t i = 0; i < 64; ++i) {
+    keys.push_back(static_cast<T>(rand_gen()));
+  }
+  for (size_t i = 0; i < 3000; ++i) {
+    T key = keys[rand_gen() % keys.size()];
+    list.Insert(key);
+    expected.insert(key);
+  }
+  for (size_t i = 0; i < keys.size(); i += 3) {
+    list.Erase(keys[i]);
+    expected.erase(keys[i]);
+  }
+  REQUIRE(std::equal(list.begin(), list.end(),
+                     expected.begin(), expected.end()));
+  for (T key : keys) {
+    // neighbours of the key, wrapping around at the extremes
+    const T prev = static_cast<T>(static_cast<uint64_t>(key) - 1);
+    const T next = static_cast<T>(static_cast<uint64_t>(key) + 1);
+    for (T probe : {key, prev, next}) {
+      REQUIRE(std::distance(list.begin(), list.LowerBound(probe)) ==
+          std::distance(expected.begin(), expected.lower_bound(probe)));
+      REQUIRE(std::distance(list.begin(), list.UpperBound(probe)) ==
+          std::distance(expected.begin(), expected.upper_bound(probe)));
+    }
+  }
+}
+
+}  // namespace
+
+TEST_CASE("vectorized search of UnrolledSkipList", "[UnrolledSkipList]") {
+  static_assert(!yaldb::impl::IsSimdSearchable<int64_t, PlainLess>::value);
+  static_assert(!yaldb::impl::IsSimdSearchable<int16_t, std::less<>>::value);
+  static_assert(
+      !yaldb::impl::IsSimdSearchable<int64_t, std::greater<int64_t>>::value);
+  RequireBoundsOfIntegers<int64_t, std::less<int64_t>>();
+  RequireBoundsOfIntegers<uint64_t, std::less<uint64_t>>();
+  RequireBoundsOfIntegers<int32_t, std::less<>>();
+  RequireBoundsOfIntegers<uint32_t, std::less<uint32_t>>();
+}
+
+TEST_CASE("vectorized search benchmark of UnrolledSkipList",
+          "[UnrolledSkipList][!benchmark]") {
+  constexpr size_t kLookups = 1 << 16;
+  // a list fitting in cache shows the compares, a large one adds the misses
+  for (size_t length : {size_t(1) << 12, size_t(1) << 20}) {
+    std::mt19937_64 rand_gen(7);
+    std::vector<int64_t> keys(length);
+    for (auto &key : keys) {
+      key = static_cast<int64_t>(rand_gen());
+    }
+    yaldb::UnrolledSkipList<int64_t> vectorized;
+    yaldb::UnrolledSkipList<int64_t, PlainLess> scalar;
+    for (int64_t key : keys) {
+      vectorized.Insert(key);
+      scalar.Insert(key);
+    }
+    std::vector<int64_t> lookups(kLookups);
+    for (auto &key : lookups) {
+      key = keys[rand_gen() % length];
+    }
+    const std::string suffix = " in " + std::to_string(length) + " keys";
+    BENCHMARK("find with std::less" + suffix) {
+      size_t found = 0;
+      for (int64_t key : lookups) {
+        found += vectorized.Find(key) != vectorized.end();
+      }
+      return found;
+    };
+    BENCHMARK("find with a plain comparator" + suffix) {
+      size_t found = 0;
+      for (int64_t key : lookups) {
+        found += scalar.Find(key) != scalar.end();
+      }
+      return found;
+    };
+  }
+}
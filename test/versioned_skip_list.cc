@@ -0,0 +1,167 @@
+//
+// Copyright [2020] <inhzus>
+//
+
+#include "yaldb/versioned_skip_list.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Entry = std::pair<size_t, size_t>;
+
+// orders the entries of a map by their key alone
+struct KeyLess {
+  bool operator()(const Entry &lhs, const Entry &rhs) const {
+    return lhs.first < rhs.first;
+  }
+};
+
+using List = yaldb::VersionedSkipList<Entry, KeyLess>;
+
+void RequireView(const List &list, const List::Snapshot *snapshot,
+                 const std::map<size_t, size_t> &expected, size_t num_keys) {
+  List::Iterator it(&list, snapshot);
+  auto expected_it = expected.begin();
+  for (it.SeekToFirst(); it.Valid(); it.Next(), ++expected_it) {
+    REQUIRE(expected_it != expected.end());
+    REQUIRE(it.value() == Entry(*expected_it));
+  }
+  REQUIRE(expected_it == expected.end());
+  for (size_t key = 0; key < num_keys; ++key) {
+    const Entry *entry = list.Find(Entry(key, 0), snapshot);
+    auto found = expected.find(key);
+    if (found == expected.end()) {
+      REQUIRE(entry == nullptr);
+    } else {
+      REQUIRE(entry != nullptr);
+      REQUIRE(*entry == Entry(*found));
+    }
+    it.Seek(Entry(key, 0));
+    auto lower = expected.lower_bound(key);
+    if (lower == expected.end()) {
+      REQUIRE_FALSE(it.Valid());
+    } else {
+      REQUIRE(it.Valid());
+      REQUIRE(it.value() == Entry(*lower));
+    }
+  }
+}
+
+}  // namespace
+
+TEST_CASE("snapshots of VersionedSkipList", "[VersionedSkipList]") {
+  constexpr size_t kKeys = 500, kRounds = 6;
+  std::mt19937 rand_gen(18);
+  List list;
+  REQUIRE(list.LastSequence() == 0);
+  std::map<size_t, size_t> latest;
+  std::vector<std::pair<const List::Snapshot *, std::map<size_t, size_t>>>
+      snapshots;
+  for (size_t round = 0; round < kRounds; ++round) {
+    for (size_t i = 0; i < kKeys; ++i) {
+      const size_t key = rand_gen() % kKeys;
+      if (rand_gen() % 4 == 0) {
+        list.Erase(Entry(key, 0));
+        latest.erase(key);
+      } else {
+        list.Insert(Entry(key, round * kKeys + i));
+        latest[key] = round * kKeys + i;
+      }
+    }
+    REQUIRE(list.LastSequence() == (round + 1) * kKeys);
+    snapshots.emplace_back(list.GetSnapshot(), latest);
+    REQUIRE(snapshots.back().first->sequence() == list.LastSequence());
+  }
+  RequireView(list, nullptr, latest, kKeys);
+  for (auto &[snapshot, expected] : snapshots) {
+    RequireView(list, snapshot, expected, kKeys);
+  }
+
+  // drop the snapshots from the middle, then from the oldest, while the
+  // remaining ones must keep their views
+  const size_t memory_usage = list.MemoryUsage();
+  size_t reclaimed = 0;
+  while (!snapshots.empty()) {
+    auto victim = snapshots.begin() + (snapshots.size() > 2 ? 1 : 0);
+    list.ReleaseSnapshot(victim->first);
+    snapshots.erase(victim);
+    reclaimed += list.Reclaim();
+    RequireView(list, nullptr, latest, kKeys);
+    for (auto &[snapshot, expected] : snapshots) {
+      RequireView(list, snapshot, expected, kKeys);
+    }
+  }
+  REQUIRE(reclaimed > 0);
+  REQUIRE(list.Reclaim() == 0);
+  // the unlinked versions stay in the arena
+  REQUIRE(list.MemoryUsage() >= memory_usage);
+}
+
+TEST_CASE("snapshots of VersionedSkipList are consistent under writes",
+          "[VersionedSkipList]") {
+  constexpr size_t kKeys = 64, kRounds = 2000;
+  List list;
+  for (size_t key = 0; key < kKeys; ++key) {
+    list.Insert(Entry(key, 0));
+  }
+  std::atomic<bool> done(false);
+  // every round overwrites the keys in ascending order, so a consistent
+  // view holds a prefix of the keys from one round and the rest from the
+  // previous one. Key kKeys is erased right after every insertion, and
+  // reclaimed while readers look
+  std::thread writer([&] {
+    for (size_t round = 1; round <= kRounds; ++round) {
+      for (size_t key = 0; key < kKeys; ++key) {
+        list.Insert(Entry(key, round));
+      }
+      list.Insert(Entry(kKeys, round));
+      list.Erase(Entry(kKeys, 0));
+      list.Reclaim();
+    }
+    done.store(true);
+  });
+  size_t views = 0;
+  while (!done.load() || views == 0) {
+    const List::Snapshot *snapshot = list.GetSnapshot();
+    const bool erased = list.Find(Entry(kKeys, 0), snapshot) == nullptr;
+    for (size_t pass = 0; pass < 2; ++pass) {
+      List::Iterator it(&list, snapshot);
+      it.SeekToFirst();
+      REQUIRE(it.Valid());
+      const size_t first = it.value().second;
+      size_t key = 0;
+      for (; it.Valid() && it.value().first < kKeys; it.Next(), ++key) {
+        REQUIRE(it.value().first == key);
+        REQUIRE((it.value().second == first ||
+            it.value().second + 1 == first));
+        REQUIRE(list.Find(Entry(key, 0), snapshot)->second ==
+            it.value().second);
+      }
+      REQUIRE(key == kKeys);
+      // the erased key stays as the snapshot saw it
+      REQUIRE(it.Valid() == !erased);
+      for (size_t i = 0; i < 64; ++i) {
+        REQUIRE((list.Find(Entry(kKeys, 0), snapshot) == nullptr) == erased);
+      }
+    }
+    // the latest view holds every key, whatever Reclaim unlinks meanwhile
+    size_t key = 0;
+    List::Iterator it(&list);
+    for (it.SeekToFirst(); it.Valid() && it.value().first < kKeys; it.Next()) {
+      REQUIRE(it.value().first == key++);
+      REQUIRE(list.Find(it.value()) != nullptr);
+    }
+    REQUIRE(key == kKeys);
+    list.ReleaseSnapshot(snapshot);
+    ++views;
+  }
+  writer.join();
+}